@@ -27,8 +27,14 @@
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <climits>
 #include <cassert>
 #include <functional>
+#include <string>
+#include <atomic>
+#include <map>
 
 #ifndef YATM_CACHE_LINE_SIZE
 	#define YATM_CACHE_LINE_SIZE (64u)
@@ -61,18 +67,100 @@
 #elif YATM_STD_THREAD
 	#include <thread>
 	#include <condition_variable>
-	#include <atomic>
 	#include <chrono>
 #endif // YATM_WIN64
 
+#if YATM_NIX
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <pthread.h>
+	#include <cerrno>
+	#include <ctime>
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <netdb.h>
+	#include <poll.h>
+#endif // YATM_NIX
+
+#if YATM_EPOLL
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+#endif // YATM_EPOLL
+
 // Some defaults for reserving space in the job queues
 #define YATM_DEFAULT_JOB_QUEUE_RESERVATION (1024u)
 #define YATM_DEFAULT_PENDING_JOB_QUEUE_RESERVATION (128u)
+#define YATM_DEFAULT_WORKER_QUEUE_RESERVATION (64u)
+#define YATM_DEFAULT_STEAL_THRESHOLD (4u)
+
+// Defaults for utilization-driven worker parking
+#define YATM_DEFAULT_QUEUE_DELAY_TARGET_US (1000u)
+#define YATM_DEFAULT_PARKING_INTERVAL_US (20000u)
+
+// Bytes each job streams through when probing memory bandwidth, well beyond the size of last level caches
+#define YATM_DEFAULT_BANDWIDTH_PROBE_SIZE (32u * 1024u * 1024u)
+
+// How many idle stacks per size class the fiber stack pool keeps committed
+#define YATM_DEFAULT_WARM_STACKS_PER_CLASS (4u)
+
+// Defaults for streaming memory-mapped files
+#define YATM_DEFAULT_STREAM_BLOCK_SIZE (1024u * 1024u)
+#define YATM_DEFAULT_STREAM_WINDOW (16u)
+
+// Defaults for admission control, CoDel's own defaults
+#define YATM_DEFAULT_ADMISSION_DELAY_TARGET_US (5000u)
+#define YATM_DEFAULT_ADMISSION_INTERVAL_US (100000u)
+
+// Defaults for coalescing submissions
+#define YATM_DEFAULT_BATCH_SIZE (64u)
+#define YATM_DEFAULT_BATCH_DELAY_US (100u)
+
+// Default number of items a strand runs each time it's dispatched
+#define YATM_DEFAULT_STRAND_ITEMS_PER_DISPATCH (16u)
+
+// Default number of jobs graph builder arenas take from the scratch allocator at once
+#define YATM_DEFAULT_GRAPH_ARENA_CHUNK_SIZE (1024u)
+
+// Default number of spare threads started for workers blocked in blocking regions
+#define YATM_DEFAULT_MAX_SPARE_WORKERS (8u)
+
+// Defaults for job pools shared between processes
+#define YATM_DEFAULT_SHARED_POOL_QUEUE_CAPACITY (1024u)
+#define YATM_DEFAULT_SHARED_POOL_BLOCK_SIZE (256u)
+#define YATM_DEFAULT_SHARED_POOL_COUNTERS (64u)
+#define YATM_DEFAULT_SHARED_POOL_TIMEOUT_MS (100u)
+
+// Defaults for offloading jobs to remote peers
+#define YATM_DEFAULT_OFFLOAD_WINDOW (32u)
+#define YATM_DEFAULT_OFFLOAD_TIMEOUT_MS (200u)
+#define YATM_DEFAULT_OFFLOAD_MAX_PAYLOAD_SIZE (64u * 1024u * 1024u)
+#define YATM_DEFAULT_OFFLOAD_RECEIVE_SIZE (64u * 1024u)
+
+// Defaults for the epoll reactor
+#define YATM_DEFAULT_REACTOR_TIMEOUT_MS (100u)
+#define YATM_DEFAULT_REACTOR_BUSY_POLL_INTERVAL_US (250u)
+#define YATM_DEFAULT_REACTOR_MAX_EVENTS (64u)
 
 namespace yatm
 {
 	static_assert(sizeof(void*) == 8, "Only 64bit platforms are currently supported");
 
+	// Affinity key used by jobs that don't prefer any particular worker.
+	static constexpr uint64_t c_noAffinity = ~0ull;
+
+	// Worker index used by threads that are not workers of the scheduler (e.g. the main thread).
+	static constexpr uint32_t c_invalidWorker = ~0u;
+
+	// Resource id used by jobs that don't need any resource tokens.
+	static constexpr uint32_t c_noResource = ~0u;
+
+	// Deadline used while no submission batcher holds jobs back.
+	static constexpr uint64_t c_noBatchDeadline = ~0ull;
+
 	// -----------------------------------------------------------------------------------------------
 	// std::bind wrapped, used specifically for the job callbacks.
 	// -----------------------------------------------------------------------------------------------
@@ -98,6 +186,21 @@ namespace yatm
 		return (uint8_t*)align((size_t)_ptr, _align);
 	}
 
+	// -----------------------------------------------------------------------------------------------
+	// Return a monotonic timestamp in microseconds.
+	// -----------------------------------------------------------------------------------------------
+	static uint64_t get_time_in_us()
+	{
+#if YATM_STD_THREAD
+		return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#elif YATM_WIN64
+		LARGE_INTEGER frequency, now;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&now);
+		return (uint64_t)((now.QuadPart / frequency.QuadPart) * 1000000ull + ((now.QuadPart % frequency.QuadPart) * 1000000ull) / frequency.QuadPart);
+#endif // YATM_STD_THREAD
+	}
+
 	// -----------------------------------------------------------------------------------------------
 	// A representation of an OS mutex.
 	// -----------------------------------------------------------------------------------------------
@@ -279,6 +382,28 @@ namespace yatm
 #endif // YATM_STD_THREAD
 		}
 
+		// -----------------------------------------------------------------------------------------------
+		// Wait on this condition variable until the condition is true or the timeout elapsed.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Condition>
+		void wait_for(scoped_lock<mutex>& _lock, uint64_t _timeoutInUs, const Condition& _condition)
+		{
+#if YATM_STD_THREAD
+			m_cv.wait_for(_lock, std::chrono::microseconds(_timeoutInUs), _condition);
+#elif YATM_WIN64
+			const ULONGLONG end = GetTickCount64() + (_timeoutInUs + 999u) / 1000u;
+			while (!_condition())
+			{
+				const ULONGLONG now = GetTickCount64();
+				if (now >= end)
+				{
+					break;
+				}
+				SleepConditionVariableCS(&m_cv, &_lock.m_mutex->m_cs, (DWORD)(end - now));
+			}
+#endif // YATM_STD_THREAD
+		}
+
 	private:
 #if YATM_STD_THREAD
 		std::condition_variable_any m_cv;
@@ -366,6 +491,18 @@ namespace yatm
 #endif // YATM_STD_THREAD
 		}
 
+		// -----------------------------------------------------------------------------------------------
+		// Returns the current value of the internal atomic counter without any ordering guarantees, for cheap polling.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_current_relaxed() const
+		{
+#if YATM_STD_THREAD
+			return m_value.load(std::memory_order_relaxed);
+#elif YATM_WIN64
+			return m_value;
+#endif // YATM_STD_THREAD
+		}
+
 	private:
 #if YATM_STD_THREAD
 		std::atomic_uint32_t m_value;
@@ -374,6 +511,33 @@ namespace yatm
 #endif // YATM_STD_THREAD
 	};
 	
+	// -----------------------------------------------------------------------------------------------
+	// Priority of a job. High priority jobs are picked before any other job and can preempt long running jobs that call
+	// scheduler::maybe_yield(). Low priority jobs are queued like normal ones, but may be shed by admission control during overload.
+	// Background jobs only run on workers that have nothing else to do, and should return early when scheduler::should_preempt() says so.
+	// -----------------------------------------------------------------------------------------------
+	enum class job_priority : uint32_t
+	{
+		normal = 0,
+		high,
+		low,
+		background
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// What limits a job. Memory-bound jobs mostly stream data to and from DRAM; running more of them than it takes to saturate
+	// memory bandwidth only slows down everything else, so the scheduler caps how many run at once (see scheduler_desc).
+	// -----------------------------------------------------------------------------------------------
+	enum class job_class : uint32_t
+	{
+		compute = 0,
+		memory_bound
+	};
+
+	static constexpr uint32_t c_numJobClasses = 2u;
+
+	struct job_batch;
+
 	// -----------------------------------------------------------------------------------------------
 	// Describes a job that the scheduler can run.
 	// -----------------------------------------------------------------------------------------------
@@ -386,6 +550,43 @@ namespace yatm
 		counter*			m_counter;
 		job*				m_parent;		
 		counter				m_pendingJobs;
+		uint64_t			m_affinity;			// Data locality key, c_noAffinity if the job can run anywhere.
+		uint32_t			m_preferredWorker;	// Worker the affinity key hashes to, resolved when the job is added.
+		uint64_t			m_queueTime;		// Timestamp in us of when the job was added to a queue, used to measure queueing delay.
+		job_priority		m_priority;
+		job_class			m_class;
+		uint32_t			m_resource;			// Resource the job takes tokens from while it runs, c_noResource if none.
+		uint32_t			m_resourceTokens;
+		job_batch*			m_batch;			// Set for jobs calling one function over an array of payloads, see scheduler::create_batch().
+		bool				m_isPublished;		// Set from when the job is added until it starts, protected by the queue mutex.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Tokens of a scheduler resource that a job needs to run, see scheduler::add_resource().
+	// -----------------------------------------------------------------------------------------------
+	struct resource_request
+	{
+		uint32_t	m_resource = c_noResource;
+		uint32_t	m_tokens = 1u;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// The payloads of a batch job, split into ranges that workers claim and process with a single call each.
+	// -----------------------------------------------------------------------------------------------
+	struct job_batch
+	{
+		using InvokeFuncPtr = void(*)(const job_batch&, size_t, size_t);
+		using FuncPtr = void(*)();
+
+		InvokeFuncPtr		m_invoke;			// Casts m_function and m_payloads back to their types and calls the function on a range.
+		FuncPtr				m_function;
+		void*				m_payloads;
+		size_t				m_count;
+		size_t				m_grainSize;		// Payloads per range.
+		uint32_t			m_numRanges;
+		counter				m_nextRange;		// Claimed atomically, workers run ranges outside of the queue lock.
+		uint32_t			m_numWorkers;		// Workers processing the batch, protected by the queue mutex.
+		bool				m_isActive;			// Listed for other workers to help with, protected by the queue mutex.
 	};
 
 	// -----------------------------------------------------------------------------------------------
@@ -483,582 +684,6196 @@ namespace yatm
 		uint32_t	m_index;		
 	};
 
+#if YATM_NIX || YATM_WIN64
 	// -----------------------------------------------------------------------------------------------
-	// A description for the scheduler to create the worker threads.
+	// A stack allocated by the stack pool. The usable range is [m_base, m_base + m_sizeInBytes), with a guard page right below m_base;
+	// stacks grow downwards so the initial stack pointer is get_top(). m_base is nullptr if the pool couldn't get the memory.
 	// -----------------------------------------------------------------------------------------------
-	struct scheduler_desc
+	struct fiber_stack
 	{
-		uint32_t	m_numThreads;																		// How many threads to use
-		uint32_t	m_stackSizeInBytes = YATM_DEFAULT_STACK_SIZE;										// Stack size in bytes of each thread (unsupported in YATM_STD_THREAD)
-		uint32_t	m_jobScratchBufferInBytes = YATM_DEFAULT_JOB_SCRATCH_BUFFER_SIZE;					// Size in bytes of the internal scratch allocator. This is used to allocate jobs and job data.
-		uint32_t	m_jobQueueReservation = YATM_DEFAULT_JOB_QUEUE_RESERVATION;							// How many jobs to reserve in the job vector.
-		uint32_t	m_pendingJobQueueReservation = YATM_DEFAULT_PENDING_JOB_QUEUE_RESERVATION;			// How many jobs to reserve in the pending job vector (jobs waiting to be kicked).
+		uint8_t*	m_base = nullptr;
+		size_t		m_sizeInBytes = 0u;
+		uint32_t	m_sizeClass = 0u;
+		bool		m_isDecommitted = false;
+
+		uint8_t* get_top() const { return m_base + m_sizeInBytes; }
 	};
 
 	// -----------------------------------------------------------------------------------------------
-	// The task scheduler, used to dispatch tasks for consumption by the worker threads.
+	// Statistics of the stack pool.
 	// -----------------------------------------------------------------------------------------------
-	class scheduler
+	struct stack_pool_stats
 	{
-	private:
-		// -----------------------------------------------------------------------------------------------
-		// Worker internal
+		uint32_t	m_allocatedStacks = 0u;			// Stacks currently handed out.
+		uint32_t	m_idleStacks = 0u;				// Stacks in the pool waiting to be reused.
+		uint32_t	m_decommittedStacks = 0u;		// Idle stacks whose memory was returned to the OS.
+		size_t		m_highWaterInBytes = 0u;		// Deepest stack usage seen on any released stack, if tracked (see scheduler_desc::m_trackStackHighWater).
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A pool of stacks for suspendable jobs. Stacks are reserved straight from the OS with a guard page below them, so an overflow
+	// faults instead of silently corrupting a neighbour. There are a few size classes derived from a base size (a quarter, 1x and 4x);
+	// idle stacks are recycled LIFO so the most recently used (and cache warm) stack is handed out first, and only the
+	// most recent few per class stay committed, the rest have their memory returned to the OS. Stacks larger than the biggest class
+	// are mapped for the caller and unmapped on release.
+	// -----------------------------------------------------------------------------------------------
+	class stack_pool
+	{
+	public:
+		static constexpr uint32_t c_numSizeClasses = 3u;
+		static constexpr uint32_t c_customSizeClass = c_numSizeClasses;
+
 		// -----------------------------------------------------------------------------------------------
-		void worker_internal(scoped_lock<mutex>& _lock)
+		stack_pool() : m_pageSize(0u), m_warmStacksPerClass(0u), m_trackHighWater(false), m_numAllocated(0u), m_highWaterInBytes(0u)
 		{
-			// Find the next job ready to be processed
-			// This is to keep this worker busy in case many dependencies are processed by other workers.
-			job* current_job = nullptr;
+			memset(m_classSizes, 0, sizeof(m_classSizes));
+		}
 
-			for (uint32_t i = 0; i < m_jobQueue.size(); ++i)
+		// -----------------------------------------------------------------------------------------------
+		~stack_pool()
+		{
+			// Stacks still handed out are the owner's responsibility, only free the idle ones.
+			YATM_ASSERT(m_numAllocated == 0u);
+			for (uint32_t c = 0; c < c_numSizeClasses; ++c)
 			{
-				job* j = m_jobQueue[i];
-				// This job has 1 remaining task, which means that all its dependencies have been processed.
-				// Pick this task, removing it from the job queue.
-				if (j->m_pendingJobs.is_equal(1u))
+				for (fiber_stack& s : m_idleStacks[c])
 				{
-					current_job = j;
-					m_jobQueue.erase(m_jobQueue.begin() + i);
-
-					break;
+					unmap(s);
 				}
+				m_idleStacks[c].clear();
 			}
+		}
 
-			if (current_job != nullptr)
-			{
-				// We found a job; since we are done with messing with the queue, unlock the mutex
-				_lock.unlock();
+		// -----------------------------------------------------------------------------------------------
+		stack_pool(const stack_pool&) = delete;
+		stack_pool& operator=(const stack_pool&) = delete;
 
-				// process job
-				if (current_job->m_function != nullptr)
-				{
-					current_job->m_function(current_job->m_data);
-				}
+		// -----------------------------------------------------------------------------------------------
+		// Initialise the size classes from the base stack size, which is rounded up to the page size. Measuring how deep released stacks
+		// were used costs a scan of their pages, so it is only done when asked for.
+		// -----------------------------------------------------------------------------------------------
+		void init(size_t _baseStackSizeInBytes, uint32_t _warmStacksPerClass, bool _trackHighWater = false)
+		{
+#if YATM_NIX
+			m_pageSize = (size_t)sysconf(_SC_PAGESIZE);
+#elif YATM_WIN64
+			SYSTEM_INFO info;
+			ZeroMemory(&info, sizeof(info));
+			GetSystemInfo(&info);
+			m_pageSize = info.dwPageSize;
+#endif // YATM_NIX
+			m_warmStacksPerClass = _warmStacksPerClass;
+			m_trackHighWater = _trackHighWater;
+
+			const size_t base = align(std::max(_baseStackSizeInBytes, 4u * m_pageSize), m_pageSize);
+			m_classSizes[0] = align(base / 4u, m_pageSize);
+			m_classSizes[1] = base;
+			m_classSizes[2] = base * 4u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Get a stack of at least the requested size from the smallest class that fits, or a stack of its own if none does.
+		// Returns an empty stack if the memory couldn't be reserved.
+		// -----------------------------------------------------------------------------------------------
+		fiber_stack allocate(size_t _minSizeInBytes)
+		{
+			uint32_t size_class = 0u;
+			while (size_class < c_numSizeClasses && m_classSizes[size_class] < _minSizeInBytes)
+			{
+				size_class++;
+			}
 
-				// decrement the counter
-				if (current_job->m_counter != nullptr)
+			fiber_stack s;
+			if (size_class < c_numSizeClasses)
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				std::vector<fiber_stack>& idle = m_idleStacks[size_class];
+				if (!idle.empty())
 				{
-					current_job->m_counter->decrement();
+					s = idle.back();
+					idle.pop_back();
 				}
+			}
 
-				// Lock the mutex again here, to prepare for access in the queue in the next worker iteration.
-				_lock.lock();
-
-				// Finish job, notifying parents recursively.
-				finish_job(current_job);
+			if (s.m_base == nullptr)
+			{
+				s = map(size_class, size_class < c_numSizeClasses ? m_classSizes[size_class] : align(_minSizeInBytes, m_pageSize));
 			}
-			else
+			else if (s.m_isDecommitted && !recommit(s))
 			{
-				// No jobs, simply yield.
-				yield();
+				unmap(s);
 			}
-		}
 
-		// -----------------------------------------------------------------------------------------------
-		// Worker entry point; pulls jobs from the global queue and processes them.
-		// -----------------------------------------------------------------------------------------------
-		uint32_t worker_entry_point()
-		{
-			while (m_isRunning)
+			if (s.m_base != nullptr)
 			{
-				// Wait for this thread to be woken up by the condition variable (there must be at least 1 job in the queue, or perhaps we want to simply stop)
-				scoped_lock<mutex> lock(&m_queueMutex);
-				m_queueConditionVar.wait(lock, [this] { return !is_paused() && ((m_jobQueue.size() > 0u) || !is_running()); });
-				
-				worker_internal(lock);
+				scoped_lock<mutex> lock(&m_mutex);
+				m_numAllocated++;
 			}
 
-			return 0u;
+			return s;
 		}
 
-	public:
 		// -----------------------------------------------------------------------------------------------
-		scheduler() :
-			m_threads(nullptr), m_scratch(nullptr)
-		{ 
-#if YATM_STD_THREAD
-			m_hwConcurency = std::thread::hardware_concurrency();
-#elif YATM_WIN64
-			SYSTEM_INFO info;
-			ZeroMemory(&info, sizeof(info));
-			GetSystemInfo(&info);
-			m_hwConcurency = info.dwNumberOfProcessors;
-#endif // YATM_STD_THREAD
-		}
-		
+		// Return a stack to the pool. Idle stacks beyond the warm count of their class give their memory back to the OS.
 		// -----------------------------------------------------------------------------------------------
-		virtual ~scheduler()
+		void release(fiber_stack& _stack)
 		{
-			set_running(false);
+			YATM_ASSERT(_stack.m_base != nullptr);
+			const size_t used = m_trackHighWater ? get_high_water_mark(_stack) : 0u;
 
-			// wait for workers to finish
-			join();
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				YATM_ASSERT(m_numAllocated > 0u);
+				m_numAllocated--;
+				m_highWaterInBytes = std::max(m_highWaterInBytes, used);
 
-			// free the thread array
-			delete[] m_threads;
-			m_threads = nullptr;
+				if (_stack.m_sizeClass == c_customSizeClass)
+				{
+					unmap(_stack);
+					return;
+				}
 
-			// free the scratch allocator
-			delete m_scratch;
-			m_scratch = nullptr;
+				std::vector<fiber_stack>& idle = m_idleStacks[_stack.m_sizeClass];
+				idle.push_back(_stack);
 
-			m_jobQueue.clear();
+				// The stack that just fell out of the warm window is the one below the most recent few.
+				// Decommit under the lock, otherwise it could be handed out again while its pages are being dropped.
+				if (idle.size() > m_warmStacksPerClass)
+				{
+					fiber_stack& s = idle[idle.size() - 1u - m_warmStacksPerClass];
+					if (!s.m_isDecommitted)
+					{
+						decommit(s);
+						s.m_isDecommitted = true;
+					}
+				}
+			}
+
+			_stack = fiber_stack();
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		scheduler(const scheduler&) = delete;
-		scheduler& operator=(const scheduler&) = delete;
+		// Return the memory of all idle stacks to the OS, keeping their address ranges for reuse.
+		// -----------------------------------------------------------------------------------------------
+		void trim()
+		{
+			scoped_lock<mutex> lock(&m_mutex);
+			for (uint32_t c = 0; c < c_numSizeClasses; ++c)
+			{
+				for (fiber_stack& s : m_idleStacks[c])
+				{
+					if (!s.m_isDecommitted)
+					{
+						decommit(s);
+						s.m_isDecommitted = true;
+					}
+				}
+			}
+		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Initialise the scheduler.
+		// How deep the stack has been used since it was last committed, with page granularity. Scans the whole stack.
 		// -----------------------------------------------------------------------------------------------
-		void init(const scheduler_desc& _desc)
+		size_t get_high_water_mark(const fiber_stack& _stack) const
 		{
-			m_numThreads = std::max(1u, std::min<uint32_t>(_desc.m_numThreads, m_hwConcurency));
-#if YATM_STD_THREAD
-			YATM_TTY("yatm is using std::thread, configurable stack size is not allowed");
-#endif // YATM_STD_THREAD
-
-			m_stackSizeInBytes = align(_desc.m_stackSizeInBytes > 0 ? _desc.m_stackSizeInBytes : YATM_DEFAULT_STACK_SIZE, 16u);
-						
-			m_threads = new thread[m_numThreads];
-			m_scratch = new scratch( align(_desc.m_jobScratchBufferInBytes, 16u), 16u);
-
-			// reserve some space in the global job queue
-			m_jobQueue.reserve(_desc.m_jobQueueReservation);
-
-			// reserve some space in the currently pending job queue
-			m_pendingJobsToAdd.reserve(_desc.m_pendingJobQueueReservation);
-
-			// enable the scheduler and let its workers run
-			set_running(true);
-			set_paused(false);
-
-			// Create N worker threads and kick them off.
-			// Each worker will process the next available job item from the global queue, resolve its dependencies and carry on until no jobs are left.
-			for (uint32_t i = 0; i < m_numThreads; ++i)
+			const size_t num_pages = _stack.m_sizeInBytes / m_pageSize;
+#if YATM_NIX
+			// Untouched stack pages are never made resident, so the lowest resident page is the deepest the stack has been.
+			std::vector<unsigned char> resident(num_pages);
+			if (mincore(_stack.m_base, _stack.m_sizeInBytes, resident.data()) == 0)
 			{
-				auto func = [](void* data) -> uint32_t
+				for (size_t i = 0; i < num_pages; ++i)
 				{
-					yatm::scheduler* sch = reinterpret_cast<yatm::scheduler*>(data);
-					return sch->worker_entry_point();
-				};
-
-				m_threads[i].create(i, m_stackSizeInBytes, func, this);
+					if (resident[i] & 1u)
+					{
+						return _stack.m_sizeInBytes - i * m_pageSize;
+					}
+				}
+			}
+			return 0u;
+#elif YATM_WIN64
+			// Freshly committed memory is zeroed, the lowest page that isn't is the deepest the stack has been.
+			for (size_t i = 0; i < num_pages; ++i)
+			{
+				const uint64_t* page = reinterpret_cast<const uint64_t*>(_stack.m_base + i * m_pageSize);
+				for (size_t w = 0; w < m_pageSize / sizeof(uint64_t); ++w)
+				{
+					if (page[w] != 0u)
+					{
+						return _stack.m_sizeInBytes - i * m_pageSize;
+					}
+				}
 			}
+			return 0u;
+#endif // YATM_NIX
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Resets the internal scratch allocator.
+		// Return the size in bytes of a size class.
 		// -----------------------------------------------------------------------------------------------
-		void reset()
+		size_t get_class_size(uint32_t _sizeClass) const
 		{
-			YATM_ASSERT(m_scratch != nullptr);
-			m_scratch->reset();
+			YATM_ASSERT(_sizeClass < c_numSizeClasses);
+			return m_classSizes[_sizeClass];
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Create a job from the scheduler scratch allocator.
+		// Return a snapshot of the pool statistics.
 		// -----------------------------------------------------------------------------------------------
-		template<typename Function>
-		job* const create_job(const Function& _function, void* const _data, counter* _counter)
+		stack_pool_stats get_stats()
 		{
-			job* const j = allocate<job>();
-
-			j->m_function = _function;
-			j->m_data = _data;
-			j->m_parent = nullptr;
-			j->m_counter = _counter;
-
-			// Initialise the job with 1 pending job (itself).
-			// Adding dependencies increments the pending counter, resolving dependencies decrements it.
-			j->m_pendingJobs.increment();
-
-			// Register this newly created job; all jobs are automatically added when the scheduler kicks-off the tasks.
-			scoped_lock<mutex> lock(&m_pendingJobsMutex);
-			m_pendingJobsToAdd.push_back(j);
+			scoped_lock<mutex> lock(&m_mutex);
 
-			return j;
+			stack_pool_stats stats;
+			stats.m_allocatedStacks = m_numAllocated;
+			stats.m_highWaterInBytes = m_highWaterInBytes;
+			for (uint32_t c = 0; c < c_numSizeClasses; ++c)
+			{
+				stats.m_idleStacks += (uint32_t)m_idleStacks[c].size();
+				for (const fiber_stack& s : m_idleStacks[c])
+				{
+					stats.m_decommittedStacks += s.m_isDecommitted ? 1u : 0u;
+				}
+			}
+			return stats;
 		}
 
+	private:
+		mutex						m_mutex;
+		size_t						m_pageSize;
+		size_t						m_classSizes[c_numSizeClasses];
+		uint32_t					m_warmStacksPerClass;
+		bool						m_trackHighWater;
+		uint32_t					m_numAllocated;
+		size_t						m_highWaterInBytes;
+		std::vector<fiber_stack>	m_idleStacks[c_numSizeClasses];
+
 		// -----------------------------------------------------------------------------------------------
-		// Create a group from the scheduler scratch allocator. A group is simply a job without any work to be done, used as a dependency in other
-		// jobs to create a hierarchy of tasks.
+		// Reserve a new stack of the specified class and size, plus its guard page. Returns an empty stack on failure.
 		// -----------------------------------------------------------------------------------------------
-		job* const create_group(job* const _parent = nullptr)
+		fiber_stack map(uint32_t _sizeClass, size_t _sizeInBytes)
 		{
-			job* const group = create_job(nullptr, nullptr, nullptr);
+			fiber_stack s;
+			const size_t total = _sizeInBytes + m_pageSize;
+#if YATM_NIX
+			int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	#ifdef MAP_STACK
+			flags |= MAP_STACK;
+	#endif // MAP_STACK
+			void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, flags, -1, 0);
+			if (mem == MAP_FAILED)
+			{
+				return s;
+			}
 
-			// If a parent is specified, setup this dependency
-			if (_parent != nullptr)
+			if (mprotect(mem, m_pageSize, PROT_NONE) != 0)
 			{
-				depend(_parent, group);
+				munmap(mem, total);
+				return s;
+			}
+#elif YATM_WIN64
+			void* mem = VirtualAlloc(nullptr, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (mem == nullptr)
+			{
+				return s;
 			}
 
-			return group;
+			DWORD old_protect;
+			if (!VirtualProtect(mem, m_pageSize, PAGE_NOACCESS, &old_protect))
+			{
+				VirtualFree(mem, 0, MEM_RELEASE);
+				return s;
+			}
+#endif // YATM_NIX
+			s.m_base = (uint8_t*)mem + m_pageSize;
+			s.m_sizeInBytes = _sizeInBytes;
+			s.m_sizeClass = _sizeClass;
+			return s;
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Allocate a temporary array using the scheduler scratch allocator.
+		// Release a stack and its guard page back to the OS.
 		// -----------------------------------------------------------------------------------------------
-		template<typename T>
-		T* allocate(size_t _count, size_t _alignment = 16u)
+		void unmap(fiber_stack& _stack)
 		{
-			uint8_t* mem = m_scratch->alloc(sizeof(T) * _count, _alignment);
-			return new(mem) T[_count];
+			uint8_t* const mem = _stack.m_base - m_pageSize;
+#if YATM_NIX
+			munmap(mem, _stack.m_sizeInBytes + m_pageSize);
+#elif YATM_WIN64
+			VirtualFree(mem, 0, MEM_RELEASE);
+#endif // YATM_NIX
+			_stack = fiber_stack();
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Allocate a temporary object using the scheduler scratch allocator.
+		// Give the physical memory of an idle stack back to the OS, keeping the address range.
 		// -----------------------------------------------------------------------------------------------
-		template<typename T>
-		T* allocate(size_t _alignment = 16u)
+		void decommit(const fiber_stack& _stack)
 		{
-			uint8_t* mem = m_scratch->alloc(sizeof(T), _alignment);
-			
-			T* obj = new(mem) T();
-			return obj;
+#if YATM_NIX
+			madvise(_stack.m_base, _stack.m_sizeInBytes, MADV_DONTNEED);
+#elif YATM_WIN64
+			VirtualFree(_stack.m_base, _stack.m_sizeInBytes, MEM_DECOMMIT);
+#endif // YATM_NIX
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Make a decommitted stack usable again. On NIX pages come back zero-filled on first touch. Returns false on failure.
+		// -----------------------------------------------------------------------------------------------
+		bool recommit(fiber_stack& _stack)
+		{
+#if YATM_WIN64
+			if (VirtualAlloc(_stack.m_base, _stack.m_sizeInBytes, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+			{
+				return false;
+			}
+#endif // YATM_WIN64
+			_stack.m_isDecommitted = false;
+			return true;
+		}
+	};
+#endif // YATM_NIX || YATM_WIN64
+
+	// -----------------------------------------------------------------------------------------------
+	// A description for the scheduler to create the worker threads.
+	// -----------------------------------------------------------------------------------------------
+	struct scheduler_desc
+	{
+		uint32_t	m_numThreads;																		// How many threads to use
+		uint32_t	m_stackSizeInBytes = YATM_DEFAULT_STACK_SIZE;										// Stack size in bytes of each thread (unsupported in YATM_STD_THREAD)
+		uint32_t	m_jobScratchBufferInBytes = YATM_DEFAULT_JOB_SCRATCH_BUFFER_SIZE;					// Size in bytes of the internal scratch allocator. This is used to allocate jobs and job data.
+		uint32_t	m_jobQueueReservation = YATM_DEFAULT_JOB_QUEUE_RESERVATION;							// How many jobs to reserve in the job vector.
+		uint32_t	m_pendingJobQueueReservation = YATM_DEFAULT_PENDING_JOB_QUEUE_RESERVATION;			// How many jobs to reserve in the pending job vector (jobs waiting to be kicked).
+		uint32_t	m_workerQueueReservation = YATM_DEFAULT_WORKER_QUEUE_RESERVATION;					// How many jobs to reserve in each worker's local queue (jobs with an affinity key).
+		uint32_t	m_stealThreshold = YATM_DEFAULT_STEAL_THRESHOLD;									// How many jobs an idle worker's local queue must hold before other workers steal from it.
+		uint32_t	m_minActiveThreads = 0u;															// Park workers down to this many when utilization is low; 0 disables parking.
+		uint32_t	m_queueDelayTargetInUs = YATM_DEFAULT_QUEUE_DELAY_TARGET_US;						// Average time a job may wait in a queue before a parked worker is woken up.
+		uint32_t	m_parkingIntervalInUs = YATM_DEFAULT_PARKING_INTERVAL_US;							// How often utilization is evaluated, at most one worker is (un)parked per interval.
+		bool		m_admissionControl = false;															// Shed low priority jobs at kick time while queueing delay stays over target.
+		uint32_t	m_admissionDelayTargetInUs = YATM_DEFAULT_ADMISSION_DELAY_TARGET_US;				// Queueing delay that jobs should stay under.
+		uint32_t	m_admissionIntervalInUs = YATM_DEFAULT_ADMISSION_INTERVAL_US;						// How long queueing delay must stay over target before shedding starts.
+		uint32_t	m_warmStacksPerClass = YATM_DEFAULT_WARM_STACKS_PER_CLASS;							// Idle fiber stacks per size class kept committed, the rest are returned to the OS (YATM_NIX and YATM_WIN64 only).
+		bool		m_trackStackHighWater = false;														// Measure how deep released fiber stacks were used, see stack_pool_stats (YATM_NIX and YATM_WIN64 only).
+		uint32_t	m_reactorTimeoutInMs = YATM_DEFAULT_REACTOR_TIMEOUT_MS;								// How long an idle worker blocks in epoll_wait before checking the queues again (I/O backends with a reactor only).
+		uint32_t	m_reactorBusyPollIntervalInUs = YATM_DEFAULT_REACTOR_BUSY_POLL_INTERVAL_US;			// How often busy workers poll the reactor when no idle worker is blocked on it (I/O backends with a reactor only).
+		uint32_t	m_memoryBoundConcurrency = 0u;														// How many memory-bound jobs may run at once; 0 for no limit.
+		bool		m_probeMemoryBandwidth = false;														// Derive the memory-bound limit from a bandwidth probe at init, if it's 0.
+		uint32_t	m_maxBackgroundWorkers = 0u;														// How many workers may run background jobs at once; 0 for no limit.
+		uint32_t	m_maxSpareWorkers = YATM_DEFAULT_MAX_SPARE_WORKERS;									// Spare threads started to run jobs while workers are blocked in blocking regions.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A description of a file to stream through scheduler::stream_file().
+	// -----------------------------------------------------------------------------------------------
+	struct stream_file_desc
+	{
+		const char*	m_path = nullptr;														// File to stream.
+		size_t		m_blockSizeInBytes = YATM_DEFAULT_STREAM_BLOCK_SIZE;					// Nominal size of a block; actual blocks are adjusted to record boundaries.
+		uint32_t	m_windowInBlocks = YATM_DEFAULT_STREAM_WINDOW;							// Blocks in flight at once, which is also the size of the reorder buffer.
+		uint32_t	m_readAheadInBlocks = YATM_DEFAULT_STREAM_WINDOW;						// How far ahead of the last dispatched block the kernel is asked to read.
+		char		m_recordDelimiter = '\n';												// Records never straddle two blocks.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A file descriptor registered with the scheduler's reactor. It owns the job its readiness events are dispatched through,
+	// so dispatching doesn't allocate; the job is re-armed for every event.
+	// -----------------------------------------------------------------------------------------------
+	struct reactor_registration
+	{
+		job									m_job;
+		std::function<void(int, uint32_t)>	m_callback;
+		int									m_fd = -1;
+		uint32_t							m_events = 0u;				// Events of interest, in the I/O backend's terms (EPOLLIN, EPOLLOUT, ... with epoll).
+		uint32_t							m_readyEvents = 0u;			// Events reported for the dispatch being processed.
+		bool								m_isRegistered = false;
+		bool								m_isInCallback = false;		// Set while the callback runs, so that unregistering can wait for it.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Statistics gathered by the scheduler while processing jobs.
+	// -----------------------------------------------------------------------------------------------
+	struct scheduler_stats
+	{
+		uint64_t	m_affinityHits = 0u;		// Jobs with an affinity key that ran on their preferred worker.
+		uint64_t	m_affinityMisses = 0u;		// Jobs with an affinity key that ran elsewhere (stolen or picked up by a waiting thread).
+		uint64_t	m_steals = 0u;				// Jobs taken from another worker's local queue.
+		uint64_t	m_handoffs = 0u;			// Jobs run straight after their last dependency, on the worker that ran it.
+		uint64_t	m_yields = 0u;				// High priority jobs run from a yield point inside another job.
+		uint64_t	m_parks = 0u;				// Times a worker was parked because utilization was low.
+		uint64_t	m_unparks = 0u;				// Times a parked worker was woken up because queueing delay went over target.
+		uint64_t	m_shedJobs = 0u;			// Low priority jobs rejected by admission control.
+		uint64_t	m_jobsPerClass[c_numJobClasses] = {};			// Jobs run, by job_class.
+		uint64_t	m_busyTimePerClassInUs[c_numJobClasses] = {};	// Time spent running jobs, by job_class.
+		uint32_t	m_activeThreads = 0u;		// Workers currently allowed to process jobs.
+		uint32_t	m_memoryBoundConcurrency = 0u;	// Memory-bound jobs allowed to run at once, 0 for no limit.
+		uint32_t	m_blockedWorkers = 0u;		// Workers currently in blocking regions.
+		uint32_t	m_spareWorkers = 0u;		// Spare threads started so far, running while workers are blocked.
+		uint32_t	m_cappedJobs = 0u;			// Queued jobs held back by the memory-bound limit or resource tokens (a lower bound).
+
+		// -----------------------------------------------------------------------------------------------
+		// Ratio of affinity jobs that ran on their preferred worker, in [0, 1].
+		// -----------------------------------------------------------------------------------------------
+		float get_affinity_hit_rate() const
+		{
+			const uint64_t total = m_affinityHits + m_affinityMisses;
+			return total > 0u ? (float)m_affinityHits / (float)total : 0.0f;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Jobs of a class completed per second a worker spent on them.
+		// -----------------------------------------------------------------------------------------------
+		float get_throughput(job_class _class) const
+		{
+			const uint64_t time = m_busyTimePerClassInUs[(uint32_t)_class];
+			return time > 0u ? (float)m_jobsPerClass[(uint32_t)_class] * 1000000.0f / (float)time : 0.0f;
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Statistics gathered by a submission batcher.
+	// -----------------------------------------------------------------------------------------------
+	struct batcher_stats
+	{
+		uint64_t	m_batches = 0u;				// Batches handed to the scheduler.
+		uint64_t	m_jobs = 0u;				// Jobs handed to the scheduler.
+		uint64_t	m_sizeFlushes = 0u;			// Batches flushed because they reached the maximum batch size.
+		uint64_t	m_timeFlushes = 0u;			// Batches flushed because their oldest job reached the maximum delay.
+		uint64_t	m_explicitFlushes = 0u;		// Batches flushed by flush() or by destroying the batcher.
+		uint32_t	m_maxBatchSize = 0u;		// Largest batch handed to the scheduler.
+
+		// -----------------------------------------------------------------------------------------------
+		// Average number of jobs per batch.
+		// -----------------------------------------------------------------------------------------------
+		float get_average_batch_size() const
+		{
+			return m_batches > 0u ? (float)m_jobs / (float)m_batches : 0.0f;
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A mutex that does nothing, for schedulers that never run jobs on more than one thread.
+	// -----------------------------------------------------------------------------------------------
+	class null_mutex
+	{
+	public:
+		void lock() {}
+		bool try_lock() { return true; }
+		void unlock() {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A condition variable that does nothing, for schedulers that never run jobs on more than one thread.
+	// -----------------------------------------------------------------------------------------------
+	class null_condition_var
+	{
+	public:
+		void notify_all() {}
+		void notify_one() {}
+
+		template<typename Lock, typename Condition>
+		void wait(Lock&, const Condition& _condition)
+		{
+			// Nothing else could ever make the condition true.
+			YATM_ASSERT(_condition());
+			(void)_condition;
+		}
+
+		template<typename Lock, typename Condition>
+		void wait_for(Lock&, uint64_t, const Condition&) {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A thread that is never started.
+	// -----------------------------------------------------------------------------------------------
+	class null_thread
+	{
+		typedef uint32_t(*ThreadEntryPoint)(void*);
+	public:
+		void create(uint32_t, size_t, ThreadEntryPoint, void* const) { YATM_ASSERT(false); }
+		void join() {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A position in a scratch allocator, see scratch_allocator::mark().
+	// -----------------------------------------------------------------------------------------------
+	struct scratch_marker
+	{
+		uint8_t*	m_position = nullptr;
+		uint32_t	m_depth = 0u;			// How many marks were open, including this one.
+		uint32_t	m_serial = 0u;			// Bumped by every mark, so that a marker rewound already doesn't match a later one at the same depth.
+		uint32_t	m_outerSerial = 0u;		// Serial of the mark that was innermost when this one was taken, innermost again once it's rewound.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A scratch allocator to handle data and job allocations. The mutex type protects concurrent allocations and can be
+	// a null_mutex when the scheduler is single threaded.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Mutex>
+	class scratch_allocator
+	{
+	public:
+		// -----------------------------------------------------------------------------------------------
+		scratch_allocator(size_t _sizeInBytes, size_t _alignment)
+			: m_sizeInBytes(_sizeInBytes), m_alignment(_alignment), m_begin(nullptr), m_end(nullptr), m_current(nullptr), m_numMarks(0u), m_lastSerial(0u), m_innermostSerial(0u)
+
+		{
+			YATM_ASSERT(is_pow2(m_alignment));
+
+			m_sizeInBytes = m_sizeInBytes;
+
+			m_begin = (uint8_t*)aligned_alloc(m_sizeInBytes, m_alignment);
+			YATM_ASSERT(m_begin != nullptr);
+
+			m_end = m_begin + m_sizeInBytes;
+			m_current = m_begin;
+		}
+
+		scratch_allocator(const scratch_allocator&) = delete;
+		scratch_allocator& operator=(const scratch_allocator&) = delete;
+
+		// -----------------------------------------------------------------------------------------------
+		~scratch_allocator()
+		{
+			if (m_begin != nullptr)
+			{
+				aligned_free(m_begin);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Reset the scratch current pointer.
+		// -----------------------------------------------------------------------------------------------
+		void reset()
+		{
+			m_current = m_begin;
+			m_numMarks = 0u;
+			m_innermostSerial = 0u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remember the current position, so that the allocations made after it can be freed with rewind(). Marks nest: they must be
+		// rewound in the reverse order they were taken.
+		// -----------------------------------------------------------------------------------------------
+		scratch_marker mark()
+		{
+			scoped_lock<Mutex> lock(&m_mutex);
+			scratch_marker marker;
+			marker.m_position = m_current;
+			marker.m_depth = ++m_numMarks;
+			marker.m_serial = ++m_lastSerial;
+			marker.m_outerSerial = m_innermostSerial;
+			m_innermostSerial = marker.m_serial;
+			return marker;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Free everything allocated since the marker was taken. Only valid if those allocations all belong to the caller, i.e. no other
+		// thread allocated in the meantime.
+		// -----------------------------------------------------------------------------------------------
+		void rewind(const scratch_marker& _marker)
+		{
+			scoped_lock<Mutex> lock(&m_mutex);
+
+			// A mark taken after this one and still open, or this one rewound twice (even once another mark took its depth), would leave
+			// its owner with freed memory.
+			YATM_ASSERT(_marker.m_depth == m_numMarks && _marker.m_serial == m_innermostSerial && _marker.m_position >= m_begin && _marker.m_position <= m_current);
+
+#if YATM_DEBUG
+			memset(_marker.m_position, 0xdd, m_current - _marker.m_position);
+#endif // YATM_DEBUG
+
+			m_current = _marker.m_position;
+			m_numMarks = _marker.m_depth - 1u;
+			m_innermostSerial = _marker.m_outerSerial;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the current (aligned) address of the scratch allocator and increment the pointer.
+		// -----------------------------------------------------------------------------------------------
+		uint8_t* alloc(size_t _size, size_t _align)
+		{
+			YATM_ASSERT(is_pow2(_align));
+
+			scoped_lock<Mutex> lock(&m_mutex);
+			m_current = align_ptr(m_current, _align);
+
+			YATM_ASSERT(m_current + _size < m_end);
+			uint8_t* mem = m_current;
+			m_current += _size;
+
+#if YATM_DEBUG
+			memset(mem, 0xbabababa, _size);
+#endif // YATM_DEBUG
+
+			return mem;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Checks if the input pointer is within the scratch allocator's memory boundaries.
+		// -----------------------------------------------------------------------------------------------
+		bool is_from(void* _ptr)
+		{
+			const uint8_t* ptr = reinterpret_cast<const uint8_t*>(_ptr);
+			return (ptr >= m_begin && ptr < m_end);
+		}
+
+	private:
+		Mutex		m_mutex;
+		uint8_t*	m_begin;
+		uint8_t*	m_end;
+		uint8_t*	m_current;
+		size_t		m_sizeInBytes;
+		size_t		m_alignment;
+		uint32_t	m_numMarks;		// Marks taken and not rewound yet.
+		uint32_t	m_lastSerial;		// Serial of the last mark taken, never reset so that markers from before a reset don't match.
+		uint32_t	m_innermostSerial;	// Serial of the innermost open mark, 0 if none.
+
+		// -----------------------------------------------------------------------------------------------
+		// Checks if the input is a power of two.
+		// -----------------------------------------------------------------------------------------------
+		bool is_pow2(size_t _n)
+		{
+			return (_n & (_n - 1)) == 0;
+		}
+
+	public:
+		// -----------------------------------------------------------------------------------------------
+		// A portable aligned allocation mechanism.
+		//
+		// Thanks to: https://gist.github.com/dblalock/255e76195676daa5cbc57b9b36d1c99a
+		// -----------------------------------------------------------------------------------------------
+
+		// -----------------------------------------------------------------------------------------------
+		void* aligned_alloc(size_t _size, size_t _alignment)
+		{
+			YATM_ASSERT(_alignment < UINT8_MAX);
+
+			// over-allocate using malloc and adjust pointer by the offset needed to align the memory to specified alignment
+			const size_t request_size = _size + _alignment;
+			uint8_t* buf = (uint8_t*)malloc(request_size);
+
+			// figure out how much we should offset our allocation by
+			const size_t remainder = ((size_t)buf) % _alignment;
+			const size_t offset = _alignment - remainder;
+			uint8_t* ret = buf + (uint8_t)offset;
+			
+			// store how many extra bytes we allocated in the byte just before the pointer we return
+			*(uint8_t*)(ret - 1) = (uint8_t)offset;
+
+			return ret;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		void aligned_free(const void* const aligned_ptr)
+		{
+			// find the base allocation by extracting the stored aligned offset and free it
+			uint32_t offset = *(((uint8_t*)aligned_ptr) - 1);
+			free(((uint8_t*)aligned_ptr) - offset);
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Scheduler policies.
+	//
+	// basic_scheduler is configured at compile time with a policies struct, providing:
+	// - thread_backend:	the thread, mutex, condition variable and stack pool types and how to yield/sleep the calling thread.
+	// - job_queue:			the queue used for the global, high priority, background and per-worker job queues. It owns its synchronisation
+	//						and provides push(), pop() (the owner's next job), steal() (a job for another worker), and size(), empty(),
+	//						reserve() and clear(). Only jobs whose dependencies are done are pushed; the scheduler decides which of the
+	//						jobs it takes may start, and sets aside those held back by the memory-bound limit or resource tokens.
+	// - idle_strategy:		what a worker does when it can't find a job to run.
+	// - allocator:			the allocator used for jobs and job data.
+	// - instrumentation:	what statistics are gathered.
+	// - io_backend:		the platform I/O behind the reactor, stream_file() and the shared pool, or null_io_backend for none. The platform macros
+	//						only pick default_io_backend; the scheduler itself doesn't check them.
+	//
+	// Custom configurations can derive from default_policies and override some of the types. Only these choices are made at compile time;
+	// parking, admission control, affinity, the reactor and the shared pool are configured at run time and cost a branch when unused.
+	// -----------------------------------------------------------------------------------------------
+
+	// -----------------------------------------------------------------------------------------------
+	// Stand-in for the stack pool on platforms without guard-paged stacks.
+	// -----------------------------------------------------------------------------------------------
+	struct null_stack_pool
+	{
+		void init(size_t, uint32_t, bool) {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Thread backend running jobs on OS worker threads (YATM_STD_THREAD or YATM_WIN64).
+	// -----------------------------------------------------------------------------------------------
+	struct os_thread_backend
+	{
+		using thread_type = yatm::thread;
+		using mutex_type = yatm::mutex;
+		using condition_var_type = yatm::condition_var;
+#if YATM_NIX || YATM_WIN64
+		using stack_pool_type = yatm::stack_pool;
+#else
+		using stack_pool_type = null_stack_pool;
+#endif // YATM_NIX || YATM_WIN64
+
+		static constexpr bool c_spawnsThreads = true;
+
+		// -----------------------------------------------------------------------------------------------
+		static uint32_t get_hardware_concurrency()
+		{
+#if YATM_STD_THREAD
+			return std::thread::hardware_concurrency();
+#elif YATM_WIN64
+			SYSTEM_INFO info;
+			ZeroMemory(&info, sizeof(info));
+			GetSystemInfo(&info);
+			return info.dwNumberOfProcessors;
+#endif // YATM_STD_THREAD
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void yield()
+		{
+#if YATM_STD_THREAD
+			std::this_thread::yield();
+#elif YATM_WIN64
+			SwitchToThread();
+#endif // YATM_STD_THREAD
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void sleep(uint32_t _ms)
+		{
+#if YATM_STD_THREAD			
+			std::this_thread::sleep_for(std::chrono::milliseconds(_ms));
+#elif YATM_WIN64
+			Sleep(_ms);
+#endif // YATM_STD_THREAD
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Thread backend without worker threads: jobs only run on the thread that waits for them, in queue order, which makes
+	// execution deterministic. Locking compiles away.
+	// -----------------------------------------------------------------------------------------------
+	struct inline_thread_backend
+	{
+		using thread_type = null_thread;
+		using mutex_type = null_mutex;
+		using condition_var_type = null_condition_var;
+		using stack_pool_type = os_thread_backend::stack_pool_type;
+
+		static constexpr bool c_spawnsThreads = false;
+
+		static uint32_t get_hardware_concurrency() { return 1u; }
+		static void yield() {}
+		static void sleep(uint32_t _ms) { os_thread_backend::sleep(_ms); }
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Job queue handing out jobs in the order they were pushed. Other workers steal in the same order, so jobs start roughly in
+	// submission order wherever they run.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Mutex>
+	class fifo_job_queue
+	{
+	public:
+		fifo_job_queue() : m_head(0u) {}
+
+		void reserve(size_t _count) { scoped_lock<Mutex> lock(&m_mutex); m_jobs.reserve(_count); }
+		void push(job* const _job) { scoped_lock<Mutex> lock(&m_mutex); m_jobs.push_back(_job); }
+		bool empty() const { scoped_lock<Mutex> lock(&m_mutex); return m_head == m_jobs.size(); }
+		size_t size() const { scoped_lock<Mutex> lock(&m_mutex); return m_jobs.size() - m_head; }
+		void clear() { scoped_lock<Mutex> lock(&m_mutex); m_jobs.clear(); m_head = 0u; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return the oldest job, nullptr if the queue is empty.
+		// -----------------------------------------------------------------------------------------------
+		job* pop()
+		{
+			scoped_lock<Mutex> lock(&m_mutex);
+			if (m_head == m_jobs.size())
+			{
+				return nullptr;
+			}
+
+			job* const j = m_jobs[m_head++];
+
+			// Taken jobs are dropped once the queue drains, or in bulk once they make up most of it, rather than shifting it every time.
+			if (m_head == m_jobs.size())
+			{
+				m_jobs.clear();
+				m_head = 0u;
+			}
+			else if (m_head >= 64u && m_head * 2u >= m_jobs.size())
+			{
+				m_jobs.erase(m_jobs.begin(), m_jobs.begin() + m_head);
+				m_head = 0u;
+			}
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return a job for another worker, the oldest as well.
+		// -----------------------------------------------------------------------------------------------
+		job* steal() { return pop(); }
+
+	private:
+		mutable Mutex		m_mutex;
+		std::vector<job*>	m_jobs;
+		size_t				m_head;		// Jobs before it have been taken.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Job queue handing out the newest job first. Trades fairness for throughput: the most recently pushed job is the likeliest to
+	// have its data in cache. Other workers steal the oldest job, which the owner would get to last.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Mutex>
+	class lifo_job_queue
+	{
+	public:
+		lifo_job_queue() : m_head(0u) {}
+
+		void reserve(size_t _count) { scoped_lock<Mutex> lock(&m_mutex); m_jobs.reserve(_count); }
+		void push(job* const _job) { scoped_lock<Mutex> lock(&m_mutex); m_jobs.push_back(_job); }
+		bool empty() const { scoped_lock<Mutex> lock(&m_mutex); return m_head == m_jobs.size(); }
+		size_t size() const { scoped_lock<Mutex> lock(&m_mutex); return m_jobs.size() - m_head; }
+		void clear() { scoped_lock<Mutex> lock(&m_mutex); m_jobs.clear(); m_head = 0u; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return the newest job, nullptr if the queue is empty.
+		// -----------------------------------------------------------------------------------------------
+		job* pop()
+		{
+			scoped_lock<Mutex> lock(&m_mutex);
+			if (m_head == m_jobs.size())
+			{
+				return nullptr;
+			}
+
+			job* const j = m_jobs.back();
+			m_jobs.pop_back();
+			if (m_head == m_jobs.size())
+			{
+				m_jobs.clear();
+				m_head = 0u;
+			}
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return the oldest job, for another worker; nullptr if the queue is empty.
+		// -----------------------------------------------------------------------------------------------
+		job* steal()
+		{
+			scoped_lock<Mutex> lock(&m_mutex);
+			if (m_head == m_jobs.size())
+			{
+				return nullptr;
+			}
+
+			job* const j = m_jobs[m_head++];
+
+			// Stolen jobs are dropped once the queue drains, or in bulk once they make up most of it, rather than shifting it every time.
+			if (m_head == m_jobs.size())
+			{
+				m_jobs.clear();
+				m_head = 0u;
+			}
+			else if (m_head >= 64u && m_head * 2u >= m_jobs.size())
+			{
+				m_jobs.erase(m_jobs.begin(), m_jobs.begin() + m_head);
+				m_head = 0u;
+			}
+			return j;
+		}
+
+	private:
+		mutable Mutex		m_mutex;
+		std::vector<job*>	m_jobs;
+		size_t				m_head;		// Jobs before it have been stolen.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Idle strategy yielding the worker's time slice (while holding the queue lock, so other threads get a chance to add work).
+	// -----------------------------------------------------------------------------------------------
+	struct yield_idle
+	{
+		template<typename Backend>
+		static void idle() { Backend::yield(); }
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Idle strategy that busy-waits for a short while, for latency sensitive schedulers that own their cores.
+	// -----------------------------------------------------------------------------------------------
+	struct spin_idle
+	{
+		template<typename Backend>
+		static void idle()
+		{
+			for (volatile uint32_t i = 0; i < 64u; i = i + 1u)
+			{
+			}
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Idle strategy that sleeps for a millisecond, trading latency for CPU time.
+	// -----------------------------------------------------------------------------------------------
+	struct sleep_idle
+	{
+		template<typename Backend>
+		static void idle() { Backend::sleep(1u); }
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Instrumentation gathering scheduler_stats. Calls are made with the queue mutex held.
+	// -----------------------------------------------------------------------------------------------
+	class stats_instrumentation
+	{
+	public:
+		void on_affinity(bool _hit) { (_hit ? m_stats.m_affinityHits : m_stats.m_affinityMisses)++; }
+		void on_steal() { m_stats.m_steals++; }
+		void on_handoff() { m_stats.m_handoffs++; }
+		void on_yield() { m_stats.m_yields++; }
+		void on_park() { m_stats.m_parks++; }
+		void on_unpark() { m_stats.m_unparks++; }
+		void on_shed() { m_stats.m_shedJobs++; }
+		void on_job(job_class _class, uint64_t _timeInUs, uint32_t _jobs) { m_stats.m_busyTimePerClassInUs[(uint32_t)_class] += _timeInUs; m_stats.m_jobsPerClass[(uint32_t)_class] += _jobs; }
+
+		// Jobs are timed to measure the throughput of each class.
+		static constexpr bool c_timesJobs = true;
+
+		void get_stats(scheduler_stats& _stats) const { _stats = m_stats; }
+		void reset() { m_stats = scheduler_stats(); }
+
+	private:
+		scheduler_stats m_stats;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Instrumentation that gathers nothing; every hook compiles away.
+	// -----------------------------------------------------------------------------------------------
+	class null_instrumentation
+	{
+	public:
+		void on_affinity(bool) {}
+		void on_steal() {}
+		void on_handoff() {}
+		void on_yield() {}
+		void on_park() {}
+		void on_unpark() {}
+		void on_shed() {}
+		void on_job(job_class, uint64_t, uint32_t) {}
+
+		static constexpr bool c_timesJobs = false;
+
+		void get_stats(scheduler_stats& _stats) const { _stats = scheduler_stats(); }
+		void reset() {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Delivers results of jobs that complete out of order to a single consumer, strictly in submission order.
+	//
+	// Each job takes a ticket when it's created and completes it with its result. Completing publishes the result in the ticket's slot
+	// of a ring buffer and then tries to become the drainer: the drainer hands consecutive ready results to the consumer until it
+	// reaches one that isn't ready. Only one thread drains at a time, so the consumer never runs concurrently with itself, and no lock is
+	// taken. The ring buffer holds a window of tickets; taking a ticket more than a window ahead of the oldest undelivered one waits,
+	// which applies backpressure to job creators when the head-of-line job is slow; jobs holding earlier tickets must have been kicked.
+	// Inside jobs, take tickets with acquire_ticket(scheduler&), which runs jobs while waiting; the head-of-line job could otherwise be
+	// queued behind the waiting one and never run.
+	// -----------------------------------------------------------------------------------------------
+	template<typename T>
+	class sequencer
+	{
+	public:
+		using ConsumerFuncPtr = std::function<void(uint64_t, T&)>;
+
+		// -----------------------------------------------------------------------------------------------
+		sequencer(uint32_t _windowSize, const ConsumerFuncPtr& _consumer)
+			: m_consumer(_consumer), m_mask(_windowSize - 1u)
+		{
+			// The window must be a power of two, so tickets map to slots with a mask.
+			YATM_ASSERT(_windowSize > 0u && (_windowSize & (_windowSize - 1u)) == 0u);
+			m_slots = new slot[_windowSize];
+
+			store(m_nextTicket, 0u);
+			store(m_head, 0u);
+			store(m_isDraining, 0u);
+			for (uint32_t i = 0; i < _windowSize; ++i)
+			{
+				store(m_slots[i].m_sequence, 0u);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		~sequencer()
+		{
+			delete[] m_slots;
+			m_slots = nullptr;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		sequencer(const sequencer&) = delete;
+		sequencer& operator=(const sequencer&) = delete;
+
+		// -----------------------------------------------------------------------------------------------
+		// Take the next ticket, yielding while the window is full. Don't call this from a job, see acquire_ticket(scheduler&).
+		// -----------------------------------------------------------------------------------------------
+		uint64_t acquire_ticket()
+		{
+			const uint64_t ticket = fetch_add(m_nextTicket, 1u);
+			while (ticket - load(m_head) > m_mask)
+			{
+				os_thread_backend::yield();
+			}
+			return ticket;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Take the next ticket, running the scheduler's jobs while the window is full. Safe to call from a job. The ticket is only taken
+		// once there is room for it: a job run while waiting may wait for a ticket itself, and must not need one its caller holds.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Scheduler>
+		uint64_t acquire_ticket(Scheduler& _scheduler)
+		{
+			uint64_t ticket = 0u;
+			_scheduler.wait_until([this, &ticket]() { return try_acquire_ticket(ticket); });
+			return ticket;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Take the next ticket if the window isn't full, returning false otherwise.
+		// -----------------------------------------------------------------------------------------------
+		bool try_acquire_ticket(uint64_t& _ticket)
+		{
+			uint64_t ticket = load(m_nextTicket);
+			while (ticket - load(m_head) <= m_mask)
+			{
+				if (compare_exchange(m_nextTicket, ticket, ticket + 1u))
+				{
+					_ticket = ticket;
+					return true;
+				}
+				ticket = load(m_nextTicket);
+			}
+			return false;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Publish the result of a ticket. If the ticket is next in line, the calling thread delivers it and any following results that
+		// are ready.
+		// -----------------------------------------------------------------------------------------------
+		void complete(uint64_t _ticket, T&& _result)
+		{
+			slot& s = m_slots[_ticket & m_mask];
+			s.m_value = std::move(_result);
+
+			// The sequence marks which ticket the slot holds a result for (+1, as 0 means empty).
+			store(s.m_sequence, _ticket + 1u);
+
+			if (_ticket == load(m_head))
+			{
+				drain();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the next ticket to be delivered to the consumer.
+		// -----------------------------------------------------------------------------------------------
+		uint64_t get_head() const { return load(m_head); }
+
+	private:
+#if YATM_STD_THREAD
+		using atomic_type = std::atomic<uint64_t>;
+#elif YATM_WIN64
+		using atomic_type = volatile LONG64;
+#endif // YATM_STD_THREAD
+
+		struct alignas(YATM_CACHE_LINE_SIZE) slot
+		{
+			T				m_value;
+			atomic_type		m_sequence;
+		};
+
+		alignas(YATM_CACHE_LINE_SIZE) atomic_type	m_nextTicket;
+		alignas(YATM_CACHE_LINE_SIZE) atomic_type	m_head;
+		alignas(YATM_CACHE_LINE_SIZE) atomic_type	m_isDraining;
+		ConsumerFuncPtr								m_consumer;
+		slot*										m_slots;
+		uint64_t									m_mask;
+
+		// -----------------------------------------------------------------------------------------------
+		// Deliver ready results in order, as long as no other thread is doing so.
+		// -----------------------------------------------------------------------------------------------
+		void drain()
+		{
+			for (;;)
+			{
+				uint64_t expected = 0u;
+				if (!compare_exchange(m_isDraining, expected, 1u))
+				{
+					// Whoever is draining will get to our result.
+					return;
+				}
+
+				uint64_t head = load(m_head);
+				while (load(m_slots[head & m_mask].m_sequence) == head + 1u)
+				{
+					m_consumer(head, m_slots[head & m_mask].m_value);
+					head++;
+
+					// Publishing the head frees the slot for the ticket a window ahead.
+					store(m_head, head);
+				}
+
+				store(m_isDraining, 0u);
+
+				// A result may have been published after our last check, by a thread that then failed to become the drainer.
+				if (load(m_slots[head & m_mask].m_sequence) != head + 1u)
+				{
+					return;
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Atomic operations, all sequentially consistent. Both complete() and drain() store one variable and then load another that the
+		// other side stores (the sequence of a slot and the head); with release/acquire the store could be reordered after the load,
+		// and each side could miss the other's update, leaving a ready result undelivered.
+		// -----------------------------------------------------------------------------------------------
+		static uint64_t load(const atomic_type& _value)
+		{
+#if YATM_STD_THREAD
+			return _value.load(std::memory_order_seq_cst);
+#elif YATM_WIN64
+			return (uint64_t)_value;
+#endif // YATM_STD_THREAD
+		}
+
+		static void store(atomic_type& _value, uint64_t _newValue)
+		{
+#if YATM_STD_THREAD
+			_value.store(_newValue, std::memory_order_seq_cst);
+#elif YATM_WIN64
+			InterlockedExchange64(&_value, (LONG64)_newValue);
+#endif // YATM_STD_THREAD
+		}
+
+		static uint64_t fetch_add(atomic_type& _value, uint64_t _add)
+		{
+#if YATM_STD_THREAD
+			return _value.fetch_add(_add);
+#elif YATM_WIN64
+			return (uint64_t)InterlockedExchangeAdd64(&_value, (LONG64)_add);
+#endif // YATM_STD_THREAD
+		}
+
+		static bool compare_exchange(atomic_type& _value, uint64_t& _expected, uint64_t _desired)
+		{
+#if YATM_STD_THREAD
+			return _value.compare_exchange_strong(_expected, _desired);
+#elif YATM_WIN64
+			const uint64_t previous = (uint64_t)InterlockedCompareExchange64(&_value, (LONG64)_desired, (LONG64)_expected);
+			const bool exchanged = previous == _expected;
+			_expected = previous;
+			return exchanged;
+#endif // YATM_STD_THREAD
+		}
+	};
+
+#if YATM_NIX
+	// -----------------------------------------------------------------------------------------------
+	// Maps function ids to functions, so that jobs can be described by plain data that other processes understand. Every process must
+	// register the same functions in the same order, e.g. before forking or at startup of the same executable.
+	// -----------------------------------------------------------------------------------------------
+	class function_registry
+	{
+	public:
+		using FuncPtr = void(*)(void* const, size_t);
+
+		// -----------------------------------------------------------------------------------------------
+		// Register a function taking a payload and its size in bytes, returning its id.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t add(FuncPtr _function)
+		{
+			YATM_ASSERT(_function != nullptr);
+			m_functions.push_back(_function);
+			return (uint32_t)m_functions.size() - 1u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the function registered with the specified id, nullptr if there is none.
+		// -----------------------------------------------------------------------------------------------
+		FuncPtr get(uint32_t _id) const
+		{
+			return _id < m_functions.size() ? m_functions[_id] : nullptr;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the number of registered functions.
+		// -----------------------------------------------------------------------------------------------
+		size_t size() const { return m_functions.size(); }
+
+	private:
+		std::vector<FuncPtr> m_functions;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A description of a shared job pool.
+	// -----------------------------------------------------------------------------------------------
+	struct shared_pool_desc
+	{
+		const char*	m_name = nullptr;													// Name of the POSIX shared memory object, e.g. "/my_pool".
+		uint32_t	m_queueCapacity = YATM_DEFAULT_SHARED_POOL_QUEUE_CAPACITY;			// Jobs that can be queued at once.
+		uint32_t	m_payloadBlockSizeInBytes = YATM_DEFAULT_SHARED_POOL_BLOCK_SIZE;	// Largest payload a job can carry.
+		uint32_t	m_numCounters = YATM_DEFAULT_SHARED_POOL_COUNTERS;					// Counters processes can wait on.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A job queue living in POSIX shared memory, which several processes on the same machine feed and take jobs from, so that they share
+	// idle cores while keeping the fault isolation of separate address spaces. A job is a registered function id and the offset of its
+	// payload, copied into a block of the segment's payload arena; it may be accounted for in one of the segment's counters.
+	//
+	// The segment is protected by a robust process-shared mutex: if a process dies holding it, the next process to lock it recovers it.
+	// Jobs taken by a process that dies are lost, as are their counter decrements.
+	// -----------------------------------------------------------------------------------------------
+	class shared_job_pool
+	{
+	public:
+		static constexpr uint32_t c_noCounter = ~0u;
+
+		// -----------------------------------------------------------------------------------------------
+		shared_job_pool() : m_header(nullptr), m_sizeInBytes(0u), m_isOwner(false) {}
+
+		// -----------------------------------------------------------------------------------------------
+		~shared_job_pool()
+		{
+			close();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		shared_job_pool(const shared_job_pool&) = delete;
+		shared_job_pool& operator=(const shared_job_pool&) = delete;
+
+		// -----------------------------------------------------------------------------------------------
+		// Create the shared memory segment; fails if it already exists. The creator unlinks it when closing.
+		// -----------------------------------------------------------------------------------------------
+		bool create(const shared_pool_desc& _desc)
+		{
+			YATM_ASSERT(m_header == nullptr && _desc.m_name != nullptr && _desc.m_queueCapacity > 0u);
+
+			const uint32_t block_size = (uint32_t)align(std::max(1u, _desc.m_payloadBlockSizeInBytes), YATM_CACHE_LINE_SIZE);
+			layout l = get_layout(_desc.m_queueCapacity, block_size, _desc.m_numCounters);
+
+			const int fd = shm_open(_desc.m_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			void* mem = MAP_FAILED;
+			if (ftruncate(fd, (off_t)l.m_size) == 0)
+			{
+				mem = mmap(nullptr, l.m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			}
+			::close(fd);
+
+			if (mem == MAP_FAILED)
+			{
+				shm_unlink(_desc.m_name);
+				return false;
+			}
+
+			m_header = (header*)mem;
+			m_sizeInBytes = l.m_size;
+			m_isOwner = true;
+			m_name = _desc.m_name;
+
+			header& h = *m_header;
+			h.m_queueCapacity = _desc.m_queueCapacity;
+			h.m_blockSize = block_size;
+			h.m_numCounters = _desc.m_numCounters;
+			h.m_queueOffset = l.m_queueOffset;
+			h.m_freeListOffset = l.m_freeListOffset;
+			h.m_countersOffset = l.m_countersOffset;
+			h.m_blocksOffset = l.m_blocksOffset;
+			h.m_head = 0u;
+			h.m_numQueued = 0u;
+			h.m_numInFlight = 0u;
+			h.m_isShutdown = 0u;
+			h.m_numExecuted = 0u;
+			memset(get_counters(), 0, sizeof(uint32_t) * h.m_numCounters);
+
+			// There are as many payload blocks as queue slots, jobs hold on to theirs until they have run.
+			uint32_t* const free_list = get_free_list();
+			for (uint32_t i = 0; i < h.m_queueCapacity; ++i)
+			{
+				free_list[i] = i + 1u;
+			}
+			h.m_freeBlock = 0u;
+
+			pthread_mutexattr_t mutex_attr;
+			pthread_mutexattr_init(&mutex_attr);
+			pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+			pthread_mutex_init(&h.m_mutex, &mutex_attr);
+			pthread_mutexattr_destroy(&mutex_attr);
+
+			pthread_condattr_t cond_attr;
+			pthread_condattr_init(&cond_attr);
+			pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+			pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+			pthread_cond_init(&h.m_queueCondition, &cond_attr);
+			pthread_cond_init(&h.m_doneCondition, &cond_attr);
+			pthread_condattr_destroy(&cond_attr);
+
+			// Publish the segment as initialised last; processes opening it wait for this.
+			__atomic_store_n(&h.m_magic, c_magic, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Open a segment created by another process.
+		// -----------------------------------------------------------------------------------------------
+		bool open(const char* _name)
+		{
+			YATM_ASSERT(m_header == nullptr && _name != nullptr);
+
+			const int fd = shm_open(_name, O_RDWR, 0600);
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			struct stat st;
+			void* mem = MAP_FAILED;
+			if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header))
+			{
+				mem = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			}
+			::close(fd);
+
+			if (mem == MAP_FAILED)
+			{
+				return false;
+			}
+
+			header* const h = (header*)mem;
+			if (__atomic_load_n(&h->m_magic, __ATOMIC_ACQUIRE) != c_magic)
+			{
+				munmap(mem, (size_t)st.st_size);
+				return false;
+			}
+
+			m_header = h;
+			m_sizeInBytes = (size_t)st.st_size;
+			m_isOwner = false;
+			m_name = _name;
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Unmap the segment, and remove it if this process created it.
+		// -----------------------------------------------------------------------------------------------
+		void close()
+		{
+			if (m_header == nullptr)
+			{
+				return;
+			}
+
+			munmap(m_header, m_sizeInBytes);
+			if (m_isOwner)
+			{
+				shm_unlink(m_name.c_str());
+			}
+
+			m_header = nullptr;
+			m_sizeInBytes = 0u;
+			m_isOwner = false;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Queue a job running the function registered as _functionId, with a copy of the payload. If a counter index is specified, the counter
+		// is incremented now and decremented once the job has run. Returns false if the queue is full or the payload too large.
+		// -----------------------------------------------------------------------------------------------
+		bool try_submit(uint32_t _functionId, const void* _payload, size_t _size, uint32_t _counter = c_noCounter)
+		{
+			YATM_ASSERT(m_header != nullptr);
+			header& h = *m_header;
+			if (_size > h.m_blockSize || (_counter != c_noCounter && _counter >= h.m_numCounters))
+			{
+				return false;
+			}
+
+			lock();
+			if (h.m_numQueued + h.m_numInFlight == h.m_queueCapacity)
+			{
+				unlock();
+				return false;
+			}
+
+			const uint32_t block = h.m_freeBlock;
+			h.m_freeBlock = get_free_list()[block];
+
+			entry& e = get_queue()[(h.m_head + h.m_numQueued) % h.m_queueCapacity];
+			e.m_functionId = _functionId;
+			e.m_counter = _counter;
+			e.m_payloadOffset = h.m_blocksOffset + (uint64_t)block * h.m_blockSize;
+			e.m_payloadSize = _size;
+			if (_size > 0u)
+			{
+				memcpy((uint8_t*)m_header + e.m_payloadOffset, _payload, _size);
+			}
+
+			h.m_numQueued++;
+			if (_counter != c_noCounter)
+			{
+				get_counters()[_counter]++;
+			}
+
+			pthread_cond_signal(&h.m_queueCondition);
+			unlock();
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Queue a job, running jobs from the pool on the calling thread while it's full.
+		// -----------------------------------------------------------------------------------------------
+		bool submit(const function_registry& _registry, uint32_t _functionId, const void* _payload, size_t _size, uint32_t _counter = c_noCounter)
+		{
+			YATM_ASSERT(m_header != nullptr);
+			if (_size > m_header->m_blockSize)
+			{
+				return false;
+			}
+
+			while (!try_submit(_functionId, _payload, _size, _counter))
+			{
+				run_one(_registry, 1u);
+			}
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Take a job from the pool and run it on the calling thread, waiting up to _timeoutInMs for one. Returns false if none was run.
+		// -----------------------------------------------------------------------------------------------
+		bool run_one(const function_registry& _registry, uint32_t _timeoutInMs)
+		{
+			YATM_ASSERT(m_header != nullptr);
+			header& h = *m_header;
+
+			lock();
+			if (_timeoutInMs > 0u)
+			{
+				const timespec deadline = get_deadline(_timeoutInMs);
+				while (h.m_numQueued == 0u && !h.m_isShutdown && wait_until(h.m_queueCondition, deadline)) {}
+			}
+
+			if (h.m_numQueued == 0u)
+			{
+				unlock();
+				return false;
+			}
+
+			// The job keeps its payload block until it has run.
+			const entry e = get_queue()[h.m_head];
+			h.m_head = (h.m_head + 1u) % h.m_queueCapacity;
+			h.m_numInFlight++;
+			h.m_numQueued--;
+			unlock();
+
+			const function_registry::FuncPtr function = _registry.get(e.m_functionId);
+			YATM_ASSERT(function != nullptr);
+			if (function != nullptr)
+			{
+				function((uint8_t*)m_header + e.m_payloadOffset, (size_t)e.m_payloadSize);
+			}
+
+			lock();
+			const uint32_t block = (uint32_t)((e.m_payloadOffset - h.m_blocksOffset) / h.m_blockSize);
+			get_free_list()[block] = h.m_freeBlock;
+			h.m_freeBlock = block;
+
+			h.m_numInFlight--;
+			h.m_numExecuted++;
+			if (e.m_counter != c_noCounter)
+			{
+				get_counters()[e.m_counter]--;
+			}
+			pthread_cond_broadcast(&h.m_doneCondition);
+			unlock();
+
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for a counter to reach 0, running jobs from the pool in the meantime.
+		// -----------------------------------------------------------------------------------------------
+		void wait(const function_registry& _registry, uint32_t _counter)
+		{
+			YATM_ASSERT(m_header != nullptr && _counter < m_header->m_numCounters);
+			while (get_counter(_counter) > 0u)
+			{
+				if (!run_one(_registry, 0u))
+				{
+					// Other processes are running the remaining jobs.
+					lock();
+					if (get_counters()[_counter] > 0u)
+					{
+						wait_until(m_header->m_doneCondition, get_deadline(1u));
+					}
+					unlock();
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the value of a counter.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_counter(uint32_t _counter)
+		{
+			YATM_ASSERT(m_header != nullptr && _counter < m_header->m_numCounters);
+			lock();
+			const uint32_t value = get_counters()[_counter];
+			unlock();
+			return value;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return how many jobs are queued, and how many jobs have run since the segment was created.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_num_queued() { lock(); const uint32_t n = m_header->m_numQueued; unlock(); return n; }
+		uint64_t get_num_executed() { lock(); const uint64_t n = m_header->m_numExecuted; unlock(); return n; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Ask every process to stop taking jobs from the pool, waking up those waiting for one.
+		// -----------------------------------------------------------------------------------------------
+		void shutdown()
+		{
+			YATM_ASSERT(m_header != nullptr);
+			lock();
+			m_header->m_isShutdown = 1u;
+			pthread_cond_broadcast(&m_header->m_queueCondition);
+			pthread_cond_broadcast(&m_header->m_doneCondition);
+			unlock();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if shutdown() was called by any process.
+		// -----------------------------------------------------------------------------------------------
+		bool is_shutdown() const { return m_header == nullptr || __atomic_load_n(&m_header->m_isShutdown, __ATOMIC_ACQUIRE) != 0u; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Wake up every thread waiting for a job, in every process; they go back to waiting if there is none.
+		// -----------------------------------------------------------------------------------------------
+		void notify_all()
+		{
+			YATM_ASSERT(m_header != nullptr);
+			pthread_cond_broadcast(&m_header->m_queueCondition);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a segment is open.
+		// -----------------------------------------------------------------------------------------------
+		bool is_open() const { return m_header != nullptr; }
+
+	private:
+		static constexpr uint32_t c_magic = 0x7961746du;	// "yatm"
+
+		struct header
+		{
+			uint32_t			m_magic;
+			uint32_t			m_queueCapacity;
+			uint32_t			m_blockSize;
+			uint32_t			m_numCounters;
+			uint64_t			m_queueOffset;
+			uint64_t			m_freeListOffset;
+			uint64_t			m_countersOffset;
+			uint64_t			m_blocksOffset;
+			pthread_mutex_t		m_mutex;
+			pthread_cond_t		m_queueCondition;	// Jobs were queued.
+			pthread_cond_t		m_doneCondition;	// Jobs have run.
+			uint32_t			m_head;
+			uint32_t			m_numQueued;
+			uint32_t			m_numInFlight;		// Jobs taken from the queue that haven't finished running yet.
+			uint32_t			m_freeBlock;		// Head of the list of free payload blocks.
+			uint32_t			m_isShutdown;
+			uint64_t			m_numExecuted;
+		};
+
+		struct entry
+		{
+			uint32_t			m_functionId;
+			uint32_t			m_counter;
+			uint64_t			m_payloadOffset;	// From the start of the segment, mappings differ between processes.
+			uint64_t			m_payloadSize;
+		};
+
+		struct layout
+		{
+			uint64_t			m_queueOffset;
+			uint64_t			m_freeListOffset;
+			uint64_t			m_countersOffset;
+			uint64_t			m_blocksOffset;
+			size_t				m_size;
+		};
+
+		header*					m_header;
+		size_t					m_sizeInBytes;
+		bool					m_isOwner;
+		std::string				m_name;
+
+		// -----------------------------------------------------------------------------------------------
+		static layout get_layout(uint32_t _queueCapacity, uint32_t _blockSize, uint32_t _numCounters)
+		{
+			layout l;
+			l.m_queueOffset = align(sizeof(header), YATM_CACHE_LINE_SIZE);
+			l.m_freeListOffset = align(l.m_queueOffset + sizeof(entry) * _queueCapacity, YATM_CACHE_LINE_SIZE);
+			l.m_countersOffset = align(l.m_freeListOffset + sizeof(uint32_t) * _queueCapacity, YATM_CACHE_LINE_SIZE);
+			l.m_blocksOffset = align(l.m_countersOffset + sizeof(uint32_t) * _numCounters, YATM_CACHE_LINE_SIZE);
+			l.m_size = (size_t)(l.m_blocksOffset + (uint64_t)_blockSize * _queueCapacity);
+			return l;
+		}
+
+		entry* get_queue() { return (entry*)((uint8_t*)m_header + m_header->m_queueOffset); }
+		uint32_t* get_free_list() { return (uint32_t*)((uint8_t*)m_header + m_header->m_freeListOffset); }
+		uint32_t* get_counters() { return (uint32_t*)((uint8_t*)m_header + m_header->m_countersOffset); }
+
+		// -----------------------------------------------------------------------------------------------
+		// Lock the segment, recovering the mutex if its previous owner died.
+		// -----------------------------------------------------------------------------------------------
+		void lock()
+		{
+			if (pthread_mutex_lock(&m_header->m_mutex) == EOWNERDEAD)
+			{
+				pthread_mutex_consistent(&m_header->m_mutex);
+			}
+		}
+
+		void unlock()
+		{
+			pthread_mutex_unlock(&m_header->m_mutex);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the point in time the specified duration from now, on the clock the conditions use.
+		// -----------------------------------------------------------------------------------------------
+		static timespec get_deadline(uint32_t _timeoutInMs)
+		{
+			timespec deadline;
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			deadline.tv_sec += _timeoutInMs / 1000u;
+			deadline.tv_nsec += (long)(_timeoutInMs % 1000u) * 1000000l;
+			if (deadline.tv_nsec >= 1000000000l)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000l;
+			}
+			return deadline;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait on a condition until the deadline, returning false once it has passed. Assumes the segment is locked.
+		// -----------------------------------------------------------------------------------------------
+		bool wait_until(pthread_cond_t& _condition, const timespec& _deadline)
+		{
+			const int result = pthread_cond_timedwait(&_condition, &m_header->m_mutex, &_deadline);
+			if (result == EOWNERDEAD)
+			{
+				pthread_mutex_consistent(&m_header->m_mutex);
+			}
+			return result != ETIMEDOUT;
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A description of remote job offloading.
+	// -----------------------------------------------------------------------------------------------
+	struct remote_offload_desc
+	{
+		uint32_t	m_windowSize = YATM_DEFAULT_OFFLOAD_WINDOW;			// Requests in flight per peer; jobs run locally while every window is full.
+		uint32_t	m_timeoutInMs = YATM_DEFAULT_OFFLOAD_TIMEOUT_MS;	// Requests a peer hasn't answered by then run locally instead.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Statistics of remote job offloading.
+	// -----------------------------------------------------------------------------------------------
+	struct remote_offload_stats
+	{
+		uint64_t	m_remoteJobs = 0u;			// Jobs whose result came back from a peer.
+		uint64_t	m_localJobs = 0u;			// Jobs run locally because no peer had room in its window.
+		uint64_t	m_timeouts = 0u;			// Jobs run locally because their peer didn't answer in time.
+		uint64_t	m_peerFailures = 0u;		// Peers whose connection was lost; their jobs run locally.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Header of the messages exchanged by remote_offloader and remote_job_server. A request is followed by its payload, its response
+	// by the payload as the function left it. Peers run the same build on the same kind of machine, so values are in host byte order.
+	// -----------------------------------------------------------------------------------------------
+	struct remote_message_header
+	{
+		uint64_t	m_requestId;
+		uint32_t	m_functionId;
+		uint32_t	m_payloadSize;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Send a whole buffer on a blocking socket. Returns false if the connection is lost.
+	// -----------------------------------------------------------------------------------------------
+	inline bool socket_send_all(int _fd, const void* _data, size_t _size)
+	{
+		const uint8_t* data = (const uint8_t*)_data;
+		while (_size > 0u)
+		{
+			const ssize_t n = send(_fd, data, _size, MSG_NOSIGNAL);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				return false;
+			}
+			data += n;
+			_size -= (size_t)n;
+		}
+		return true;
+	}
+
+	// -----------------------------------------------------------------------------------------------
+	// Receive a whole buffer from a blocking socket. Returns false if the connection is closed or lost.
+	// -----------------------------------------------------------------------------------------------
+	inline bool socket_recv_all(int _fd, void* _data, size_t _size)
+	{
+		uint8_t* data = (uint8_t*)_data;
+		while (_size > 0u)
+		{
+			const ssize_t n = recv(_fd, data, _size, 0);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				return false;
+			}
+			data += n;
+			_size -= (size_t)n;
+		}
+		return true;
+	}
+
+	// -----------------------------------------------------------------------------------------------
+	// Open a TCP socket connected to the specified host, or listening on the specified address when _listen is set. Nagle's algorithm
+	// is disabled, messages are small and latency matters more. Returns -1 on failure.
+	// -----------------------------------------------------------------------------------------------
+	inline int socket_open(const char* _host, uint16_t _port, bool _listen)
+	{
+		addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = _listen ? AI_PASSIVE : 0;
+
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(_host, std::to_string(_port).c_str(), &hints, &addresses) != 0)
+		{
+			return -1;
+		}
+
+		int fd = -1;
+		for (addrinfo* a = addresses; a != nullptr && fd < 0; a = a->ai_next)
+		{
+			fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+			if (fd < 0)
+			{
+				continue;
+			}
+
+			const int one = 1;
+			bool ok;
+			if (_listen)
+			{
+				setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+				ok = ::bind(fd, a->ai_addr, a->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0;
+			}
+			else
+			{
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				ok = ::connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+			}
+
+			if (!ok)
+			{
+				::close(fd);
+				fd = -1;
+			}
+		}
+
+		freeaddrinfo(addresses);
+		return fd;
+	}
+#endif // YATM_NIX
+
+	// -----------------------------------------------------------------------------------------------
+	// An event reported by an I/O backend's poller: the pointer the fd was watched with and the events it's ready for.
+	// -----------------------------------------------------------------------------------------------
+	struct io_event
+	{
+		void*		m_data;
+		uint32_t	m_events;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// How a range of a mapped file is about to be used, passed to the I/O backend's advise().
+	// -----------------------------------------------------------------------------------------------
+	enum class io_advice : uint8_t
+	{
+		sequential,			// The whole mapping is read once, front to back.
+		will_need,			// The range is read soon, the kernel may start reading it.
+		dont_need			// The range won't be read again, its pages may be dropped.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// Stand-ins for the shared job pool and its function registry, for I/O backends that have none. Attaching one is an error.
+	// -----------------------------------------------------------------------------------------------
+	class null_function_registry {};
+
+	struct null_shared_pool
+	{
+		bool is_open() const { return false; }
+		bool is_shutdown() const { return true; }
+		bool run_one(const null_function_registry&, uint32_t) { return false; }
+		void notify_all() {}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// I/O backend without any platform I/O: no reactor, no shared job pool, and files can't be streamed.
+	// -----------------------------------------------------------------------------------------------
+	struct null_io_backend
+	{
+		using shared_pool_type = null_shared_pool;
+		using function_registry_type = null_function_registry;
+
+		static constexpr bool c_hasReactor = false;
+		static constexpr bool c_hasSharedPool = false;
+
+		// Reactor: a poller watching one-shot fds, and a wake fd interrupting it.
+		static bool open_poller(int& _pollFd, int& _wakeFd) { _pollFd = -1; _wakeFd = -1; return false; }
+		static void close_poller(int, int) {}
+		static bool watch(int, int, uint32_t, void* const) { return false; }
+		static void rearm(int, int, uint32_t, void* const) {}
+		static void unwatch(int, int) {}
+		static uint32_t poll(int, int, io_event* const, uint32_t, int) { return 0u; }
+		static void wake(int) {}
+
+		// Files: read-only mappings and hints about how they are read.
+		static bool map_file(const char* const, const char*& _data, size_t& _sizeInBytes) { _data = nullptr; _sizeInBytes = 0u; return false; }
+		static void unmap_file(const char* const, size_t) {}
+		static void advise(const char* const, size_t, io_advice) {}
+		static size_t get_page_size() { return 4096u; }
+	};
+
+#if YATM_NIX
+	// -----------------------------------------------------------------------------------------------
+	// I/O backend for POSIX systems: files are streamed through mmap and idle workers can serve a shared job pool. No reactor.
+	// -----------------------------------------------------------------------------------------------
+	struct posix_io_backend : null_io_backend
+	{
+		using shared_pool_type = shared_job_pool;
+		using function_registry_type = function_registry;
+
+		static constexpr bool c_hasSharedPool = true;
+
+		// -----------------------------------------------------------------------------------------------
+		// Map a whole file for reading. An empty file succeeds without a mapping.
+		// -----------------------------------------------------------------------------------------------
+		static bool map_file(const char* const _path, const char*& _data, size_t& _sizeInBytes)
+		{
+			_data = nullptr;
+			_sizeInBytes = 0u;
+
+			const int fd = open(_path, O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0)
+			{
+				close(fd);
+				return false;
+			}
+
+			if (st.st_size == 0)
+			{
+				close(fd);
+				return true;
+			}
+
+			void* const mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (mapping == MAP_FAILED)
+			{
+				return false;
+			}
+
+			_data = (const char*)mapping;
+			_sizeInBytes = (size_t)st.st_size;
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void unmap_file(const char* const _data, size_t _sizeInBytes)
+		{
+			munmap((void*)_data, _sizeInBytes);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void advise(const char* const _data, size_t _sizeInBytes, io_advice _advice)
+		{
+			const int advice = _advice == io_advice::sequential ? MADV_SEQUENTIAL : _advice == io_advice::will_need ? MADV_WILLNEED : MADV_DONTNEED;
+			madvise((void*)_data, _sizeInBytes, advice);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static size_t get_page_size() { return (size_t)sysconf(_SC_PAGESIZE); }
+	};
+#endif // YATM_NIX
+
+#if YATM_EPOLL
+	// -----------------------------------------------------------------------------------------------
+	// I/O backend for Linux: the POSIX backend with a reactor built on epoll, woken up through an event fd. Events are epoll's
+	// (EPOLLIN, EPOLLOUT, ...).
+	// -----------------------------------------------------------------------------------------------
+	struct epoll_io_backend : posix_io_backend
+	{
+		static constexpr bool c_hasReactor = true;
+
+		// -----------------------------------------------------------------------------------------------
+		// Create the poller and its wake fd, which is watched without any data.
+		// -----------------------------------------------------------------------------------------------
+		static bool open_poller(int& _pollFd, int& _wakeFd)
+		{
+			_pollFd = epoll_create1(EPOLL_CLOEXEC);
+			_wakeFd = eventfd(0u, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (_pollFd < 0 || _wakeFd < 0)
+			{
+				close_poller(_pollFd, _wakeFd);
+				_pollFd = -1;
+				_wakeFd = -1;
+				return false;
+			}
+
+			epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.ptr = nullptr;
+			epoll_ctl(_pollFd, EPOLL_CTL_ADD, _wakeFd, &ev);
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void close_poller(int _pollFd, int _wakeFd)
+		{
+			if (_pollFd >= 0)
+			{
+				close(_pollFd);
+			}
+			if (_wakeFd >= 0)
+			{
+				close(_wakeFd);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Watch an fd for one event; it stays disarmed after being reported until rearm() is called.
+		// -----------------------------------------------------------------------------------------------
+		static bool watch(int _pollFd, int _fd, uint32_t _events, void* const _data)
+		{
+			epoll_event ev = {};
+			ev.events = _events | EPOLLONESHOT;
+			ev.data.ptr = _data;
+			return epoll_ctl(_pollFd, EPOLL_CTL_ADD, _fd, &ev) == 0;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void rearm(int _pollFd, int _fd, uint32_t _events, void* const _data)
+		{
+			epoll_event ev = {};
+			ev.events = _events | EPOLLONESHOT;
+			ev.data.ptr = _data;
+			epoll_ctl(_pollFd, EPOLL_CTL_MOD, _fd, &ev);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		static void unwatch(int _pollFd, int _fd)
+		{
+			epoll_ctl(_pollFd, EPOLL_CTL_DEL, _fd, nullptr);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait up to _timeoutInMs for watched fds to become ready, returning how many events were written to _events. Being woken up
+		// through the wake fd reports no event.
+		// -----------------------------------------------------------------------------------------------
+		static uint32_t poll(int _pollFd, int _wakeFd, io_event* const _events, uint32_t _maxEvents, int _timeoutInMs)
+		{
+			epoll_event events[YATM_DEFAULT_REACTOR_MAX_EVENTS];
+			const int num_events = epoll_wait(_pollFd, events, (int)std::min<uint32_t>(_maxEvents, YATM_DEFAULT_REACTOR_MAX_EVENTS), _timeoutInMs);
+
+			uint32_t count = 0u;
+			for (int i = 0; i < num_events; ++i)
+			{
+				if (events[i].data.ptr == nullptr)
+				{
+					uint64_t value;
+					(void)!read(_wakeFd, &value, sizeof(value));
+				}
+				else
+				{
+					_events[count].m_data = events[i].data.ptr;
+					_events[count].m_events = events[i].events;
+					count++;
+				}
+			}
+			return count;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Interrupt the thread blocked in poll(), if any.
+		// -----------------------------------------------------------------------------------------------
+		static void wake(int _wakeFd)
+		{
+			const uint64_t value = 1u;
+			(void)!write(_wakeFd, &value, sizeof(value));
+		}
+	};
+#endif // YATM_EPOLL
+
+	// -----------------------------------------------------------------------------------------------
+	// The I/O backend of the default configurations: the richest one the platform has. This is the only place the platform picks a
+	// policy; a configuration naming its backends explicitly doesn't depend on it.
+	// -----------------------------------------------------------------------------------------------
+#if YATM_EPOLL
+	using default_io_backend = epoll_io_backend;
+#elif YATM_NIX
+	using default_io_backend = posix_io_backend;
+#else
+	using default_io_backend = null_io_backend;
+#endif // YATM_EPOLL
+
+	// -----------------------------------------------------------------------------------------------
+	// The default configuration: OS worker threads, FIFO queues, yielding when idle and full statistics.
+	// -----------------------------------------------------------------------------------------------
+	struct default_policies
+	{
+		using thread_backend = os_thread_backend;
+		using job_queue = fifo_job_queue<os_thread_backend::mutex_type>;
+		using idle_strategy = yield_idle;
+		using allocator = scratch_allocator<os_thread_backend::mutex_type>;
+		using instrumentation = stats_instrumentation;
+		using io_backend = default_io_backend;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A single threaded, deterministic configuration: jobs run in FIFO order on the waiting thread, without locks or statistics.
+	// -----------------------------------------------------------------------------------------------
+	struct single_threaded_policies
+	{
+		using thread_backend = inline_thread_backend;
+		using job_queue = fifo_job_queue<inline_thread_backend::mutex_type>;
+		using idle_strategy = yield_idle;
+		using allocator = scratch_allocator<inline_thread_backend::mutex_type>;
+		using instrumentation = null_instrumentation;
+		using io_backend = default_io_backend;
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// The task scheduler, used to dispatch tasks for consumption by the worker threads.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Policies>
+	class basic_scheduler
+	{
+	private:
+		using thread_backend = typename Policies::thread_backend;
+		using thread_type = typename thread_backend::thread_type;
+		using mutex_type = typename thread_backend::mutex_type;
+		using condition_var_type = typename thread_backend::condition_var_type;
+		using job_queue = typename Policies::job_queue;
+		using idle_strategy = typename Policies::idle_strategy;
+		using allocator = typename Policies::allocator;
+		using io_backend = typename Policies::io_backend;
+		using stack_pool_type = typename thread_backend::stack_pool_type;
+		using shared_pool_type = typename io_backend::shared_pool_type;
+		using function_registry_type = typename io_backend::function_registry_type;
+		using instrumentation = typename Policies::instrumentation;
+
+		// -----------------------------------------------------------------------------------------------
+		// Per-worker state. Jobs with an affinity key are queued in the local queue of the worker they hash to.
+		// -----------------------------------------------------------------------------------------------
+		struct worker_data
+		{
+			basic_scheduler*	m_scheduler = nullptr;
+			uint32_t			m_index = 0u;
+			uint32_t			m_numRunning = 0u;		// Jobs the worker is running, more than 1 while it helps out in wait().
+			bool				m_isBlocking = false;	// In a blocking region, so it won't get to its local queue for a while.
+			job_queue			m_localQueue;
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// A named pool of tokens; jobs take some while they run. Protected by the queue mutex.
+		// -----------------------------------------------------------------------------------------------
+		struct resource
+		{
+			std::string	m_name;
+			uint32_t	m_capacity;
+			uint32_t	m_available;
+			uint32_t	m_numQueued;		// Queued jobs needing tokens of this resource.
+			std::map<uint32_t, uint32_t>	m_numQueuedByTokens;	// Queued jobs per number of tokens needed. Amounts stay once seen, to avoid reallocating.
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return the next job of the queue that may start, stealing it if the queue belongs to another worker. Queued jobs
+		// have their dependencies done, but memory-bound jobs may have to wait for the limit and others for resource tokens; those are
+		// set aside until they may start (see requeue_capped_jobs()), so that they don't hold up the rest of the queue. Assumes the queue
+		// mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		job* take_ready_job(job_queue& _queue, bool _steal = false)
+		{
+			while (job* const j = _steal ? _queue.steal() : _queue.pop())
+			{
+				if (!is_startable(j))
+				{
+					m_cappedJobs.push_back(j);
+					continue;
+				}
+
+				if (j->m_priority != job_priority::background)
+				{
+					m_numReadyForeground.decrement();
+				}
+				start_job(j);
+				return j;
+			}
+
+			return nullptr;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a job may start now, as far as the memory-bound limit and resource tokens are concerned. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool is_startable(const job* const _job) const
+		{
+			return (_job->m_class != job_class::memory_bound || m_numRunningMemoryBound < m_memoryBoundLimit) &&
+				(_job->m_resource == c_noResource || m_resources[_job->m_resource].m_available >= _job->m_resourceTokens);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Account for a job leaving the queues to run: it takes its resource tokens and counts towards its limits. Assumes the queue
+		// mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void start_job(job* const _job)
+		{
+			m_numQueuedJobs--;
+
+			// A job added again while it runs (e.g. a reactor registration re-armed by its callback) is queued once this run finishes.
+			_job->m_isPublished = false;
+
+			if (_job->m_resource != c_noResource)
+			{
+				resource& r = m_resources[_job->m_resource];
+				r.m_available -= _job->m_resourceTokens;
+				r.m_numQueued--;
+				r.m_numQueuedByTokens[_job->m_resourceTokens]--;
+			}
+
+			if (_job->m_class == job_class::memory_bound)
+			{
+				m_numQueuedMemoryBound--;
+				m_numRunningMemoryBound++;
+			}
+
+			if (_job->m_priority == job_priority::background)
+			{
+				m_numQueuedBackground--;
+				m_numRunningBackground++;
+			}
+
+			if (_job->m_batch != nullptr)
+			{
+				begin_batch(_job);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Queue the jobs set aside by take_ready_job() that may start now, in the order they were set aside. Called when memory-bound
+		// jobs finish, tokens are given back or limits are raised. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void requeue_capped_jobs()
+		{
+			size_t num_capped = 0u;
+			for (job* const j : m_cappedJobs)
+			{
+				if (is_startable(j))
+				{
+					queue_job(j);
+				}
+				else
+				{
+					m_cappedJobs[num_capped++] = j;
+				}
+			}
+			m_cappedJobs.resize(num_capped);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove and return the next ready high priority job. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		job* take_high_priority_job()
+		{
+			if (m_highPriorityJobQueue.empty())
+			{
+				return nullptr;
+			}
+
+			job* const j = take_ready_job(m_highPriorityJobQueue);
+			if (j != nullptr)
+			{
+				m_numReadyHighPriorityJobs.decrement();
+			}
+
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// A batch job was taken from a queue. If it has more than one range, list it so that other workers can help; it counts as
+		// a queued job until all its ranges are claimed. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void begin_batch(job* const _job)
+		{
+			job_batch& batch = *_job->m_batch;
+			batch.m_numWorkers = 1u;
+
+			// Helping comes before any queued job, so background batches are left to the worker that took them.
+			if (batch.m_numRanges > 1u && _job->m_priority != job_priority::background)
+			{
+				batch.m_isActive = true;
+				m_activeBatches.push_back(_job);
+				m_numQueuedJobs++;
+				if (_job->m_class == job_class::memory_bound)
+				{
+					m_numQueuedMemoryBound++;
+				}
+				m_queueConditionVar.notify_all();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return a batch job that still has unclaimed ranges, unlisting the exhausted ones. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		job* take_active_batch()
+		{
+			for (size_t i = 0; i < m_activeBatches.size(); )
+			{
+				job* const j = m_activeBatches[i];
+				job_batch& batch = *j->m_batch;
+				if (batch.m_nextRange.get_current() >= batch.m_numRanges)
+				{
+					end_batch(j);
+					continue;
+				}
+
+				// Every worker helping with a memory-bound batch counts towards the limit.
+				if (j->m_class == job_class::memory_bound)
+				{
+					if (m_numRunningMemoryBound >= m_memoryBoundLimit)
+					{
+						++i;
+						continue;
+					}
+					m_numRunningMemoryBound++;
+				}
+
+				batch.m_numWorkers++;
+				return j;
+			}
+
+			return nullptr;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Stop offering a batch job to other workers. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void end_batch(job* const _job)
+		{
+			job_batch& batch = *_job->m_batch;
+			if (batch.m_isActive)
+			{
+				batch.m_isActive = false;
+				m_activeBatches.erase(std::find(m_activeBatches.begin(), m_activeBatches.end(), _job));
+				m_numQueuedJobs--;
+				if (_job->m_class == job_class::memory_bound)
+				{
+					m_numQueuedMemoryBound--;
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Find the next job for the specified worker: high priority jobs first, then batches other workers started, its own local queue,
+		// the global queue and finally the local queues of other workers. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		job* acquire_job(uint32_t _workerIndex)
+		{
+			const bool is_worker = _workerIndex < m_numThreads;
+
+			// High priority jobs come first, regardless of their affinity.
+			job* j = take_high_priority_job();
+			if (j == nullptr)
+			{
+				// Helping with a batch doesn't take it off a queue, it has been accounted for already.
+				j = take_active_batch();
+				if (j != nullptr)
+				{
+					return j;
+				}
+			}
+
+			if (j == nullptr && is_worker)
+			{
+				j = take_ready_job(m_workers[_workerIndex].m_localQueue);
+			}
+
+			if (j == nullptr)
+			{
+				j = take_ready_job(m_jobQueue);
+			}
+
+			if (j == nullptr)
+			{
+				// Steal from other workers. Only do so when the owner is busy running a job, has a backlog, or is parked or blocked, so that idle
+				// workers don't drain each other's queues and defeat the point of the affinity key. While paused, threads blocked in wait() take anything.
+				const uint32_t first = is_worker ? _workerIndex + 1u : 0u;
+				for (uint32_t i = 0; i < m_numThreads && j == nullptr; ++i)
+				{
+					worker_data& victim = m_workers[(first + i) % m_numThreads];
+					if (victim.m_index == _workerIndex || victim.m_localQueue.empty())
+					{
+						continue;
+					}
+
+					if (victim.m_numRunning > 0u || victim.m_localQueue.size() > m_stealThreshold || !is_worker_available(victim.m_index) || is_paused())
+					{
+						j = take_ready_job(victim.m_localQueue, true);
+						if (j != nullptr)
+						{
+							m_instrumentation.on_steal();
+						}
+					}
+				}
+			}
+
+			// Background jobs only go to workers with nothing else to do, not to threads waiting for other work to finish.
+			if (j == nullptr && (is_worker || m_numThreads == 0u) && m_numRunningBackground < m_backgroundLimit && !m_backgroundJobQueue.empty())
+			{
+				j = take_ready_job(m_backgroundJobQueue);
+			}
+
+			if (j != nullptr)
+			{
+				on_job_taken(j, _workerIndex);
+			}
+
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Take the parent a job run by the specified worker just made ready, so that it runs next on the same worker while the job's
+		// output is still in its caches. The parent isn't queued yet: if anything else should run first, its affinity places it on another
+		// worker or it can't start yet, it is queued as usual and nullptr is returned. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		job* take_ready_parent(uint32_t _workerIndex, job* const _parent)
+		{
+			if (_parent == nullptr)
+			{
+				return nullptr;
+			}
+
+			// The affinity key keeps the parent's own data in another worker's caches, which outweighs the output of this job.
+			if (_parent->m_priority == job_priority::high || _parent->m_priority == job_priority::background || m_numReadyHighPriorityJobs.get_current() > 0u ||
+				_workerIndex >= m_numActiveThreads || !is_running() || is_paused() ||
+				(_parent->m_preferredWorker < m_numThreads && _parent->m_preferredWorker != _workerIndex) || !is_startable(_parent))
+			{
+				on_job_ready(_parent);
+				return nullptr;
+			}
+
+			m_instrumentation.on_handoff();
+			start_job(_parent);
+			on_job_taken(_parent, _workerIndex);
+			return _parent;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Account for a job taken from the queues by the specified worker. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void on_job_taken(job* const _job, uint32_t _workerIndex)
+		{
+			if (is_queue_timing_enabled())
+			{
+				const uint64_t now = get_time_in_us();
+				const uint64_t delay = now - _job->m_queueTime;
+				if (is_parking_enabled())
+				{
+					m_periodQueueDelayInUs += delay;
+					m_periodJobs++;
+				}
+
+				if (m_admissionControl)
+				{
+					update_admission(now, delay);
+				}
+			}
+
+			if (_job->m_affinity != c_noAffinity)
+			{
+				m_instrumentation.on_affinity(_job->m_preferredWorker == _workerIndex);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Run a job that was removed from a queue and finish it. Expects the queue mutex to be held, which is released while the job runs.
+		// Returns the job's parent if finishing the job made it ready, nullptr otherwise; the parent isn't queued, see take_ready_parent().
+		// -----------------------------------------------------------------------------------------------
+		job* run_job(scoped_lock<mutex_type>& _lock, job* const _job)
+		{
+			// We found a job; since we are done with messing with the queue, unlock the mutex
+			_lock.unlock();
+
+			const bool time_job = is_parking_enabled() || instrumentation::c_timesJobs;
+			const uint64_t start_time = time_job ? get_time_in_us() : 0u;
+
+			// Jobs can run nested (waits and yield points), remember what this thread was running before.
+			worker_identity& id = get_worker_identity();
+			job* const previous_job = id.m_currentJob;
+			id.m_currentJob = _job;
+
+			// process job
+			if (_job->m_batch != nullptr)
+			{
+				// Claim ranges until there are none left; other workers may be claiming from the same batch.
+				job_batch& batch = *_job->m_batch;
+				for (uint32_t range = batch.m_nextRange.increment() - 1u; range < batch.m_numRanges; range = batch.m_nextRange.increment() - 1u)
+				{
+					const size_t begin = (size_t)range * batch.m_grainSize;
+					batch.m_invoke(batch, begin, std::min(batch.m_grainSize, batch.m_count - begin));
+				}
+			}
+			else if (_job->m_function != nullptr)
+			{
+				_job->m_function(_job->m_data);
+			}
+
+			id.m_currentJob = previous_job;
+
+			const uint64_t end_time = time_job ? get_time_in_us() : 0u;
+
+			// Lock the mutex again here, to prepare for access in the queue in the next worker iteration.
+			_lock.lock();
+
+			if (is_parking_enabled())
+			{
+				m_periodBusyTimeInUs += end_time - start_time;
+				update_parking(end_time);
+			}
+
+			// Let another memory-bound job start, if one is waiting for the limit.
+			if (_job->m_class == job_class::memory_bound)
+			{
+				m_numRunningMemoryBound--;
+				if (m_numQueuedMemoryBound > 0u)
+				{
+					requeue_capped_jobs();
+					m_queueConditionVar.notify_one();
+				}
+			}
+
+			if (_job->m_priority == job_priority::background)
+			{
+				m_numRunningBackground--;
+				if (m_numQueuedBackground > 0u)
+				{
+					m_queueConditionVar.notify_one();
+				}
+			}
+
+			// A batch job is finished by the last worker leaving it, once all of its ranges have run.
+			if (_job->m_batch != nullptr)
+			{
+				if (--_job->m_batch->m_numWorkers > 0u)
+				{
+					m_instrumentation.on_job(_job->m_class, end_time - start_time, 0u);
+					return nullptr;
+				}
+				end_batch(_job);
+			}
+			m_instrumentation.on_job(_job->m_class, end_time - start_time, 1u);
+
+			// Give the resource tokens back; several queued jobs may fit in them.
+			if (_job->m_resource != c_noResource)
+			{
+				resource& r = m_resources[_job->m_resource];
+				r.m_available += _job->m_resourceTokens;
+				if (r.m_numQueued > 0u)
+				{
+					requeue_capped_jobs();
+					m_queueConditionVar.notify_all();
+				}
+			}
+
+			// Finish job, notifying parents recursively. A parent made ready is left for the caller to run or queue.
+			// The job may be recycled as soon as it's finished (waiters reset the scratch allocator), so grab its counter first.
+			counter* const job_counter = _job->m_counter;
+			job* ready_parent = nullptr;
+
+			// decrement the counter, only after the scheduler is done with the job. A job held by its function finishes later.
+			if (!finish_job(_job, false, &ready_parent))
+			{
+				return nullptr;
+			}
+
+			if (job_counter != nullptr)
+			{
+				job_counter->decrement();
+			}
+
+			// The parent hasn't run, so it can't have been recycled.
+			return ready_parent;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Keep the job running on the calling thread from finishing when its function returns, e.g. while its result is computed
+		// elsewhere. Its counter and dependents resolve once it has returned and release_job() was called, in any order.
+		// -----------------------------------------------------------------------------------------------
+		job* hold_current_job()
+		{
+			job* const j = get_worker_identity().m_currentJob;
+			YATM_ASSERT(j != nullptr && j->m_batch == nullptr);
+
+			j->m_pendingJobs.increment();
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Let a job held by hold_current_job() finish. Can be called from any thread.
+		// -----------------------------------------------------------------------------------------------
+		void release_job(job* const _job)
+		{
+			counter* const job_counter = _job->m_counter;
+			bool is_finished = false;
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				is_finished = finish_job(_job);
+			}
+
+			if (is_finished && job_counter != nullptr)
+			{
+				job_counter->decrement();
+			}
+
+			// The job may have made a parent ready.
+			m_queueConditionVar.notify_one();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Worker internal
+		// -----------------------------------------------------------------------------------------------
+		void worker_internal(scoped_lock<mutex_type>& _lock, uint32_t _workerIndex)
+		{
+			// Find the next job ready to be processed
+			// This is to keep this worker busy in case many dependencies are processed by other workers.
+			job* current_job = acquire_job(_workerIndex);
+
+			if (current_job != nullptr)
+			{
+				// Other workers steal from the local queue of a busy worker, rather than leaving its jobs waiting behind the one it runs.
+				const bool is_worker = _workerIndex < m_numThreads;
+				if (is_worker)
+				{
+					m_workers[_workerIndex].m_numRunning++;
+				}
+
+				// Keep the lock between a job and the parent it made ready, so that no other worker takes the parent in the meantime.
+				while (current_job != nullptr)
+				{
+					current_job = take_ready_parent(_workerIndex, run_job(_lock, current_job));
+				}
+
+				if (is_worker)
+				{
+					m_workers[_workerIndex].m_numRunning--;
+				}
+			}
+			else
+			{
+				// No jobs, let the idle strategy decide what to do.
+				idle_strategy::template idle<thread_backend>();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Worker entry point; pulls jobs from the global queue and processes them.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t worker_entry_point(uint32_t _workerIndex)
+		{
+			set_current_worker(this, _workerIndex);
+
+			while (m_isRunning)
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+
+				// Surplus workers are parked on their own condition variable, so that kicks don't wake them up.
+				if (_workerIndex >= m_numActiveThreads)
+				{
+					m_parkConditionVar.wait(lock, [this, _workerIndex] { return (_workerIndex < m_numActiveThreads) || !is_running(); });
+					continue;
+				}
+
+				// Wait for this thread to be woken up by the condition variable (there must be at least 1 job in the queue, or perhaps we want to simply stop)
+				// While a submission batcher holds jobs back, wake up in time to flush them, or when a sooner deadline is set.
+				m_numWaitingThreads++;
+				const uint64_t batch_deadline = m_batchDeadlineInUs;
+				const auto is_woken = [this, _workerIndex, batch_deadline] { return (!is_paused() && has_startable_jobs()) || (_workerIndex >= m_numActiveThreads) || !is_running() || reactor_needs_poller() || shared_pool_needs_waiter() || m_batchDeadlineInUs != batch_deadline || batches_need_flush(); };
+				if (batch_deadline != c_noBatchDeadline)
+				{
+					const uint64_t now = get_time_in_us();
+					m_queueConditionVar.wait_for(lock, batch_deadline > now ? batch_deadline - now : 0u, is_woken);
+				}
+				else
+				{
+					m_queueConditionVar.wait(lock, is_woken);
+				}
+				m_numWaitingThreads--;
+				
+				if (_workerIndex < m_numActiveThreads && is_running())
+				{
+					// Hand the batches that waited long enough to the scheduler, rather than leaving them to their producer's next submit.
+					if (batches_need_flush())
+					{
+						flush_expired_batches(lock);
+						continue;
+					}
+					// Idle workers block in the reactor, busy ones poll it every so often so that sockets aren't starved by a long backlog.
+					const bool is_idle = is_paused() || m_numQueuedJobs == 0u;
+					if (reactor_needs_poller() && (is_idle || get_time_in_us() - m_reactorLastPollInUs >= m_reactorBusyPollIntervalInUs))
+					{
+						poll_reactor(lock, _workerIndex, is_idle ? (int)m_reactorTimeoutInMs : 0);
+						continue;
+					}
+
+					// Idle workers run jobs other processes queued in the shared pool.
+					if (shared_pool_needs_waiter() && m_numQueuedJobs == 0u)
+					{
+						wait_shared_pool(lock);
+						continue;
+					}
+					worker_internal(lock, _workerIndex);
+				}
+			}
+
+			return 0u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// A thread started to run jobs in place of workers blocked in blocking regions.
+		// -----------------------------------------------------------------------------------------------
+		struct spare_worker
+		{
+			basic_scheduler*	m_scheduler;
+			uint32_t			m_index;
+			thread_type			m_thread;
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Start the thread of the spare with the specified index, which begin_blocking() reserved under the queue mutex; the mutex must
+		// not be held, thread creation can take a while. Returns the spare, to be added to the spares once the mutex is taken again. If
+		// creating the thread throws, the reservation is given up.
+		// -----------------------------------------------------------------------------------------------
+		spare_worker* start_spare(uint32_t _spareIndex)
+		{
+			struct reservation
+			{
+				basic_scheduler*	m_scheduler;
+				spare_worker*		m_spare;
+
+				~reservation()
+				{
+					if (m_spare != nullptr)
+					{
+						delete m_spare;
+
+						scoped_lock<mutex_type> lock(&m_scheduler->m_queueMutex);
+						m_scheduler->m_isStartingSpare = false;
+					}
+				}
+			};
+
+			spare_worker* const spare = new spare_worker();
+			spare->m_scheduler = this;
+			spare->m_index = _spareIndex;
+			reservation pending = { this, spare };
+
+			auto func = [](void* data) -> uint32_t
+			{
+				spare_worker* s = reinterpret_cast<spare_worker*>(data);
+				return s->m_scheduler->spare_entry_point(s->m_index);
+			};
+			spare->m_thread.create(m_numThreads + _spareIndex, m_stackSizeInBytes, func, spare);
+
+			pending.m_spare = nullptr;
+			return spare;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Spare worker entry point. As many spares run as there are blocked workers, the most recently started ones retire first. Spares
+		// have no local queue; they take jobs from the global queue and steal like threads waiting on the scheduler.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t spare_entry_point(uint32_t _spareIndex)
+		{
+			const uint32_t worker_index = m_numThreads + _spareIndex;
+			set_current_worker(this, worker_index);
+
+			while (m_isRunning)
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+
+				if (_spareIndex >= m_numBlockedWorkers)
+				{
+					m_spareConditionVar.wait(lock, [this, _spareIndex] { return (_spareIndex < m_numBlockedWorkers) || !is_running(); });
+					continue;
+				}
+
+				m_numWaitingThreads++;
+				m_queueConditionVar.wait(lock, [this, _spareIndex] { return (!is_paused() && has_startable_jobs()) || (_spareIndex >= m_numBlockedWorkers) || !is_running(); });
+				m_numWaitingThreads--;
+
+				if (_spareIndex < m_numBlockedWorkers && is_running())
+				{
+					worker_internal(lock, worker_index);
+				}
+			}
+
+			return 0u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Thread local worker identity, used to route waits from inside jobs to the right local queue.
+		// -----------------------------------------------------------------------------------------------
+		struct worker_identity
+		{
+			const basic_scheduler*	m_scheduler;
+			uint32_t			m_index;
+			job*				m_currentJob;		// Innermost job running on this thread.
+		};
+
+		static worker_identity& get_worker_identity()
+		{
+			static thread_local worker_identity s_identity = { nullptr, c_invalidWorker, nullptr };
+			return s_identity;
+		}
+
+		static void set_current_worker(const basic_scheduler* _scheduler, uint32_t _index)
+		{
+			worker_identity& id = get_worker_identity();
+			id.m_scheduler = _scheduler;
+			id.m_index = _index;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if workers may be parked when utilization is low.
+		// -----------------------------------------------------------------------------------------------
+		bool is_parking_enabled() const { return m_minActiveThreads > 0u; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if the time jobs spend in the queues is measured.
+		// -----------------------------------------------------------------------------------------------
+		bool is_queue_timing_enabled() const { return m_admissionControl || is_parking_enabled(); }
+
+		// -----------------------------------------------------------------------------------------------
+		// Track the queueing delay of dequeued jobs, CoDel style: a delay over target is fine as long as it drains within an interval.
+		// If every job dequeued for a whole interval waited longer than the target, the queue is standing and low priority jobs are shed
+		// until a job goes through under target, or the queues run empty. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void update_admission(uint64_t _now, uint64_t _delay)
+		{
+			if (_delay < m_admissionDelayTargetInUs || m_numQueuedJobs == 0u)
+			{
+				m_admissionAboveTargetSinceInUs = 0u;
+				m_isShedding.store(false, std::memory_order_relaxed);
+			}
+			else if (m_admissionAboveTargetSinceInUs == 0u)
+			{
+				m_admissionAboveTargetSinceInUs = _now;
+			}
+			else if (_now - m_admissionAboveTargetSinceInUs >= m_admissionIntervalInUs)
+			{
+				m_isShedding.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Evaluate the utilization of the active workers once per interval, parking or unparking one worker at a time.
+		// Unparking is driven by the average queueing delay going over target; parking requires both a low delay and low utilization,
+		// the gap between the two thresholds acting as hysteresis. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void update_parking(uint64_t _now)
+		{
+			const uint64_t elapsed = _now - m_periodStartInUs;
+			if (_now < m_periodStartInUs || elapsed < m_parkingIntervalInUs)
+			{
+				return;
+			}
+
+			const uint64_t average_delay = m_periodJobs > 0u ? m_periodQueueDelayInUs / m_periodJobs : 0u;
+			const float utilization = (float)m_periodBusyTimeInUs / (float)(elapsed * m_numActiveThreads);
+
+			if ((average_delay > m_queueDelayTargetInUs || m_numQueuedJobs > m_numActiveThreads) && m_numActiveThreads < m_numThreads)
+			{
+				m_numActiveThreads++;
+				m_instrumentation.on_unpark();
+				m_parkConditionVar.notify_all();
+			}
+			else if (average_delay < m_queueDelayTargetInUs / 2u && utilization < 0.5f && m_numActiveThreads > m_minActiveThreads)
+			{
+				// The worker with the highest index parks itself when it next checks the queue.
+				m_numActiveThreads--;
+				m_instrumentation.on_park();
+				m_queueConditionVar.notify_all();
+			}
+
+			m_periodStartInUs = _now;
+			m_periodBusyTimeInUs = 0u;
+			m_periodQueueDelayInUs = 0u;
+			m_periodJobs = 0u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Hash an affinity key to a worker index.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t hash_affinity(uint64_t _key) const
+		{
+			// splitmix64 finaliser, so that sequential shard indices spread evenly.
+			_key ^= _key >> 30;
+			_key *= 0xbf58476d1ce4e5b9ull;
+			_key ^= _key >> 27;
+			_key *= 0x94d049bb133111ebull;
+			_key ^= _key >> 31;
+
+			// Hash over all workers, so that a key keeps its worker as others park, unpark and block. Only the keys of parked or blocked
+			// workers, which wouldn't get to their local queue for a while, move to the next available one.
+			const uint32_t worker = (uint32_t)(_key % m_numThreads);
+			if (is_worker_available(worker))
+			{
+				return worker;
+			}
+
+			const uint32_t first = (uint32_t)((_key / m_numThreads) % m_numActiveThreads);
+			for (uint32_t i = 0; i < m_numActiveThreads; ++i)
+			{
+				const uint32_t candidate = (first + i) % m_numActiveThreads;
+				if (is_worker_available(candidate))
+				{
+					return candidate;
+				}
+			}
+
+			// Every active worker is blocked; spares steal from them.
+			return first;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a worker gets to its local queue, i.e. it isn't parked or in a blocking region. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool is_worker_available(uint32_t _workerIndex) const
+		{
+			return _workerIndex < m_numActiveThreads && !m_workers[_workerIndex].m_isBlocking;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if file descriptors are registered but no worker is polling them. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool reactor_needs_poller() const
+		{
+			return io_backend::c_hasReactor && m_numReactorRegistrations > 0u && !m_isReactorPolling;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if there are queued jobs a worker may start; memory-bound and background jobs don't count while their limit is reached,
+		// nor do jobs needing more tokens of a resource than it has left, so that workers sleep rather than spin on them. Assumes the
+		// queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool has_startable_jobs() const
+		{
+			const uint32_t background_blocked = m_numRunningBackground >= m_backgroundLimit ? m_numQueuedBackground : 0u;
+
+			// A job can be blocked for several reasons, only the largest count is certain to be blocked.
+			return m_numQueuedJobs > std::max(get_num_capped_jobs(), background_blocked);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return a lower bound of the queued jobs held back by the memory-bound limit or by resource tokens. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_num_capped_jobs() const
+		{
+			const uint32_t memory_bound_blocked = m_numRunningMemoryBound >= m_memoryBoundLimit ? m_numQueuedMemoryBound : 0u;
+
+			// Jobs needing more tokens than are available are blocked, even when some tokens are left.
+			uint32_t resource_blocked = 0u;
+			for (const resource& r : m_resources)
+			{
+				if (r.m_numQueued > 0u)
+				{
+					for (auto it = r.m_numQueuedByTokens.upper_bound(r.m_available); it != r.m_numQueuedByTokens.end(); ++it)
+					{
+						resource_blocked += it->second;
+					}
+				}
+			}
+
+			return std::max(memory_bound_blocked, resource_blocked);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a shared job pool is attached but no worker is waiting for its jobs. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool shared_pool_needs_waiter() const
+		{
+			return io_backend::c_hasSharedPool && m_sharedPool != nullptr && !m_isSharedPoolWaiting && !is_paused() && !m_sharedPool->is_shutdown();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a submission batcher has jobs that waited long enough to be flushed. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool batches_need_flush() const
+		{
+			return m_batchDeadlineInUs != c_noBatchDeadline && get_time_in_us() >= m_batchDeadlineInUs;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Make sure an idle worker wakes up by the given time to flush submission batchers.
+		// -----------------------------------------------------------------------------------------------
+		void arm_batch_deadline(uint64_t _deadlineInUs)
+		{
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			if (_deadlineInUs < m_batchDeadlineInUs)
+			{
+				// Waiting workers took the previous deadline into account, let them pick up the new one.
+				m_batchDeadlineInUs = _deadlineInUs;
+				m_queueConditionVar.notify_all();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Flush the submission batchers whose oldest job waited long enough, and set the deadline of the others. Assumes the queue
+		// mutex is held; it is released meanwhile, since batchers are locked before the queue.
+		// -----------------------------------------------------------------------------------------------
+		void flush_expired_batches(scoped_lock<mutex_type>& _lock)
+		{
+			m_batchDeadlineInUs = c_noBatchDeadline;
+			_lock.unlock();
+			{
+				scoped_lock<mutex_type> batchers_lock(&m_batchersMutex);
+				for (submission_batcher* const batcher : m_batchers)
+				{
+					batcher->flush_expired();
+				}
+			}
+			_lock.lock();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a worker is blocked outside of the queue condition variable, where notifications don't reach it. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool is_worker_blocked() const
+		{
+			return m_isReactorPolling || m_isSharedPoolWaiting;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Interrupt workers blocked in the reactor or waiting for the shared pool.
+		// -----------------------------------------------------------------------------------------------
+		void wake_blocked_workers()
+		{
+			if (m_reactorWakeFd >= 0)
+			{
+				io_backend::wake(m_reactorWakeFd);
+			}
+			if (m_sharedPool != nullptr)
+			{
+				m_sharedPool->notify_all();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for a job from the shared pool and run it. Only one worker waits at a time. Expects the queue mutex to be held, which is
+		// released while waiting.
+		// -----------------------------------------------------------------------------------------------
+		void wait_shared_pool(scoped_lock<mutex_type>& _lock)
+		{
+			shared_pool_type* const pool = m_sharedPool;
+			const function_registry_type* const registry = m_sharedRegistry;
+
+			m_isSharedPoolWaiting = true;
+			_lock.unlock();
+
+			const bool ran = pool->run_one(*registry, m_sharedPoolTimeoutInMs);
+
+			_lock.lock();
+			m_isSharedPoolWaiting = false;
+
+			// Keep another idle worker waiting for the pool while this one checks the queues.
+			if (ran)
+			{
+				m_queueConditionVar.notify_one();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for file descriptors to become ready and queue their jobs in the local queue of the polling worker, where they run without
+		// any further wake-up. Only one worker polls at a time. Expects the queue mutex to be held, which is released while polling.
+		// -----------------------------------------------------------------------------------------------
+		void poll_reactor(scoped_lock<mutex_type>& _lock, uint32_t _workerIndex, int _timeoutInMs)
+		{
+			m_isReactorPolling = true;
+			_lock.unlock();
+
+			io_event events[YATM_DEFAULT_REACTOR_MAX_EVENTS];
+			reactor_registration* ready[YATM_DEFAULT_REACTOR_MAX_EVENTS];
+			uint32_t num_ready = 0u;
+			{
+				scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+
+				// The poller is the only thread holding registrations it got from the kernel, and it holds none between two polls.
+				free_retired_registrations();
+			}
+
+			// Being woken up through the wake fd reports no event.
+			const uint32_t num_events = io_backend::poll(m_reactorPollFd, m_reactorWakeFd, events, YATM_DEFAULT_REACTOR_MAX_EVENTS, _timeoutInMs);
+			{
+				scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+				for (uint32_t i = 0; i < num_events; ++i)
+				{
+					reactor_registration* const r = (reactor_registration*)events[i].m_data;
+					if (r->m_isRegistered)
+					{
+						// Registrations are one-shot, the fd stays disarmed until its job has run.
+						r->m_readyEvents = events[i].m_events;
+						r->m_job.m_pendingJobs.increment();
+						ready[num_ready++] = r;
+					}
+				}
+
+				_lock.lock();
+				for (uint32_t i = 0; i < num_ready; ++i)
+				{
+					add_job(&ready[i]->m_job, _workerIndex);
+				}
+			}
+
+			m_isReactorPolling = false;
+			m_reactorLastPollInUs = get_time_in_us();
+
+			// Another idle worker takes over polling while this one runs the callbacks; others only steal past the threshold.
+			if (num_ready > m_stealThreshold)
+			{
+				m_queueConditionVar.notify_all();
+			}
+			else
+			{
+				m_queueConditionVar.notify_one();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Run the callback of a registration and arm its fd again, unless it was unregistered in the meantime.
+		// -----------------------------------------------------------------------------------------------
+		void dispatch_registration(reactor_registration* const _registration)
+		{
+			{
+				scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+				if (!_registration->m_isRegistered)
+				{
+					return;
+				}
+				_registration->m_isInCallback = true;
+			}
+
+			_registration->m_callback(_registration->m_fd, _registration->m_readyEvents);
+
+			scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+			_registration->m_isInCallback = false;
+			if (_registration->m_isRegistered)
+			{
+				io_backend::rearm(m_reactorPollFd, _registration->m_fd, _registration->m_events, _registration);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Free unregistered registrations whose job is not queued or running anymore. Assumes the reactor mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void free_retired_registrations()
+		{
+			auto it = std::remove_if(m_retiredRegistrations.begin(), m_retiredRegistrations.end(), [](reactor_registration* const _registration)
+			{
+				if (!_registration->m_job.m_pendingJobs.is_done())
+				{
+					return false;
+				}
+
+				delete _registration;
+				return true;
+			});
+			m_retiredRegistrations.erase(it, m_retiredRegistrations.end());
+		}
+
+	public:
+		// -----------------------------------------------------------------------------------------------
+		basic_scheduler() :
+			m_numQueuedJobs(0u), m_numQueuedMemoryBound(0u), m_numRunningMemoryBound(0u), m_memoryBoundLimit(~0u), m_numQueuedBackground(0u), m_numRunningBackground(0u), m_backgroundLimit(~0u), m_numBlockedWorkers(0u), m_maxSpareWorkers(0u), m_isStartingSpare(false), m_numWaitingThreads(0u), m_stealThreshold(YATM_DEFAULT_STEAL_THRESHOLD), m_numActiveThreads(0u), m_minActiveThreads(0u), m_admissionControl(false), m_threads(nullptr), m_workers(nullptr), m_scratch(nullptr)
+		{ 
+			m_hwConcurency = thread_backend::get_hardware_concurrency();
+		}
+		
+		// -----------------------------------------------------------------------------------------------
+		virtual ~basic_scheduler()
+		{
+			set_running(false);
+
+			// wait for workers to finish, if the scheduler was ever initialised
+			if (m_threads != nullptr)
+			{
+				join();
+			}
+
+			// free the thread array
+			delete[] m_threads;
+			m_threads = nullptr;
+
+			// free the worker data
+			delete[] m_workers;
+			m_workers = nullptr;
+
+			// free the scratch allocator
+			delete m_scratch;
+			m_scratch = nullptr;
+
+			m_jobQueue.clear();
+			m_highPriorityJobQueue.clear();
+			m_backgroundJobQueue.clear();
+			m_cappedJobs.clear();
+
+			// the workers are gone, nothing references the registrations anymore
+			for (reactor_registration* r : m_reactorRegistrations)
+			{
+				delete r;
+			}
+			for (reactor_registration* r : m_retiredRegistrations)
+			{
+				delete r;
+			}
+			m_reactorRegistrations.clear();
+			m_retiredRegistrations.clear();
+
+			if (m_reactorPollFd >= 0)
+			{
+				io_backend::close_poller(m_reactorPollFd, m_reactorWakeFd);
+				m_reactorPollFd = -1;
+				m_reactorWakeFd = -1;
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		basic_scheduler(const basic_scheduler&) = delete;
+		basic_scheduler& operator=(const basic_scheduler&) = delete;
+
+		// -----------------------------------------------------------------------------------------------
+		// Initialise the scheduler.
+		// -----------------------------------------------------------------------------------------------
+		void init(const scheduler_desc& _desc)
+		{
+			// Without worker threads, jobs only run on threads waiting for them.
+			m_numThreads = thread_backend::c_spawnsThreads ? std::max(1u, std::min<uint32_t>(_desc.m_numThreads, m_hwConcurency)) : 0u;
+#if YATM_STD_THREAD
+			if (thread_backend::c_spawnsThreads)
+			{
+				YATM_TTY("yatm is using std::thread, configurable stack size is not allowed");
+			}
+#endif // YATM_STD_THREAD
+
+			// Start with every worker active, parking kicks in once utilization has been measured.
+			m_numActiveThreads = m_numThreads;
+			m_minActiveThreads = std::min(_desc.m_minActiveThreads, m_numThreads);
+			m_queueDelayTargetInUs = _desc.m_queueDelayTargetInUs;
+			m_parkingIntervalInUs = std::max(1u, _desc.m_parkingIntervalInUs);
+			m_periodStartInUs = get_time_in_us();
+			m_periodBusyTimeInUs = 0u;
+			m_periodQueueDelayInUs = 0u;
+			m_periodJobs = 0u;
+
+			m_admissionControl = _desc.m_admissionControl;
+			m_admissionDelayTargetInUs = _desc.m_admissionDelayTargetInUs;
+			m_admissionIntervalInUs = _desc.m_admissionIntervalInUs;
+			m_admissionAboveTargetSinceInUs = 0u;
+			m_isShedding = false;
+
+			m_memoryBoundLimit = _desc.m_memoryBoundConcurrency > 0u ? _desc.m_memoryBoundConcurrency : ~0u;
+			m_backgroundLimit = _desc.m_maxBackgroundWorkers > 0u ? _desc.m_maxBackgroundWorkers : ~0u;
+			m_maxSpareWorkers = thread_backend::c_spawnsThreads ? _desc.m_maxSpareWorkers : 0u;
+
+			m_stackSizeInBytes = align(_desc.m_stackSizeInBytes > 0 ? _desc.m_stackSizeInBytes : YATM_DEFAULT_STACK_SIZE, 16u);
+
+			// Fiber stacks use the same base size as the worker threads.
+			m_stackPool.init(m_stackSizeInBytes, _desc.m_warmStacksPerClass, _desc.m_trackStackHighWater);
+
+			// The wake fd has no registration, it only interrupts the poller.
+			if (io_backend::c_hasReactor)
+			{
+				io_backend::open_poller(m_reactorPollFd, m_reactorWakeFd);
+				YATM_ASSERT(m_reactorPollFd >= 0 && m_reactorWakeFd >= 0);
+			}
+
+			m_reactorTimeoutInMs = _desc.m_reactorTimeoutInMs;
+			m_reactorBusyPollIntervalInUs = _desc.m_reactorBusyPollIntervalInUs;
+			m_reactorLastPollInUs = 0u;
+			m_numReactorRegistrations = 0u;
+			m_isReactorPolling = false;
+						
+			m_threads = new thread_type[m_numThreads];
+			m_workers = new worker_data[m_numThreads];
+			m_stealThreshold = _desc.m_stealThreshold;
+			m_scratch = new allocator( align(_desc.m_jobScratchBufferInBytes, 16u), 16u);
+
+			// reserve some space in the global job queues
+			m_jobQueue.reserve(_desc.m_jobQueueReservation);
+			m_highPriorityJobQueue.reserve(_desc.m_pendingJobQueueReservation);
+			m_backgroundJobQueue.reserve(_desc.m_pendingJobQueueReservation);
+
+			// reserve some space in the currently pending job queue
+			m_pendingJobsToAdd.reserve(_desc.m_pendingJobQueueReservation);
+
+			// reserve some space in the per-worker queues, used for jobs with an affinity key
+			for (uint32_t i = 0; i < m_numThreads; ++i)
+			{
+				m_workers[i].m_scheduler = this;
+				m_workers[i].m_index = i;
+				m_workers[i].m_localQueue.reserve(_desc.m_workerQueueReservation);
+			}
+
+			// enable the scheduler and let its workers run
+			set_running(true);
+			set_paused(false);
+
+			// Create N worker threads and kick them off.
+			// Each worker will process the next available job item from the global queue, resolve its dependencies and carry on until no jobs are left.
+			for (uint32_t i = 0; i < m_numThreads; ++i)
+			{
+				auto func = [](void* data) -> uint32_t
+				{
+					worker_data* w = reinterpret_cast<worker_data*>(data);
+					return w->m_scheduler->worker_entry_point(w->m_index);
+				};
+
+				m_threads[i].create(i, m_stackSizeInBytes, func, &m_workers[i]);
+			}
+
+			// The probe needs the workers running.
+			if (_desc.m_probeMemoryBandwidth && _desc.m_memoryBoundConcurrency == 0u)
+			{
+				probe_memory_bandwidth();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Resets the internal scratch allocator.
+		// -----------------------------------------------------------------------------------------------
+		void reset()
+		{
+			YATM_ASSERT(m_scratch != nullptr);
+			m_scratch->reset();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remember the current position of the internal scratch allocator, so that a subsystem can free its temporary allocations with
+		// scratch_rewind() without resetting everyone else's. See scratch_scope.
+		// -----------------------------------------------------------------------------------------------
+		scratch_marker scratch_mark()
+		{
+			YATM_ASSERT(m_scratch != nullptr);
+			return m_scratch->mark();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Free what was allocated from the internal scratch allocator since the marker was taken; marks must be rewound innermost first.
+		// The allocations must all belong to the caller: jobs created since the mark must have finished, and no other thread may have
+		// allocated in the meantime.
+		// -----------------------------------------------------------------------------------------------
+		void scratch_rewind(const scratch_marker& _marker)
+		{
+			YATM_ASSERT(m_scratch != nullptr);
+			m_scratch->rewind(_marker);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Marks the scheduler scratch allocator when created and rewinds it when destroyed.
+		// -----------------------------------------------------------------------------------------------
+		class scratch_scope
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			explicit scratch_scope(basic_scheduler& _scheduler)
+				: m_scheduler(&_scheduler), m_marker(_scheduler.scratch_mark())
+			{
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~scratch_scope()
+			{
+				m_scheduler->scratch_rewind(m_marker);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			scratch_scope(const scratch_scope&) = delete;
+			scratch_scope& operator=(const scratch_scope&) = delete;
+
+		private:
+			basic_scheduler*	m_scheduler;
+			scratch_marker		m_marker;
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Create a job from the scheduler scratch allocator.
+		// Jobs sharing an affinity key (e.g. the index of the data shard they process) prefer to run on the same worker,
+		// so that they can reuse its caches. Other workers may still steal them when that worker is busy.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Function>
+		job* const create_job(const Function& _function, void* const _data, counter* _counter, uint64_t _affinity = c_noAffinity)
+		{
+			job* const j = allocate<job>();
+			init_job(j, _function, _data, _counter, _affinity);
+
+			// Register this newly created job; all jobs are automatically added when the scheduler kicks-off the tasks.
+			scoped_lock<mutex_type> lock(&m_pendingJobsMutex);
+			m_pendingJobsToAdd.push_back(j);
+
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Create a job from the scheduler scratch allocator that needs tokens of a resource to run. It stays queued, without occupying a
+		// worker, until its dependencies are done and the resource has enough tokens; they are given back when the job finishes.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Function>
+		job* const create_job(const Function& _function, void* const _data, counter* _counter, const resource_request& _request)
+		{
+			job* const j = allocate<job>();
+			init_job(j, _function, _data, _counter, c_noAffinity);
+			set_resource(j, _request);
+
+			scoped_lock<mutex_type> lock(&m_pendingJobsMutex);
+			m_pendingJobsToAdd.push_back(j);
+
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Create a group from the scheduler scratch allocator. A group is simply a job without any work to be done, used as a dependency in other
+		// jobs to create a hierarchy of tasks.
+		// -----------------------------------------------------------------------------------------------
+		job* const create_group(job* const _parent = nullptr)
+		{
+			job* const group = create_job(nullptr, nullptr, nullptr);
+
+			// If a parent is specified, setup this dependency
+			if (_parent != nullptr)
+			{
+				depend(_parent, group);
+			}
+
+			return group;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Create a batch job from the scheduler scratch allocator: a single function called over an array of payloads. Workers claim ranges of
+		// _grainSize payloads and call _function(T* _payloads, size_t _count) once per range, so the function can vectorize across payloads.
+		// Several workers process a batch at once; as a whole it's a single job, its counter and dependencies apply to all of its payloads.
+		// A grain size of 0 picks one that gives every worker a few ranges.
+		// -----------------------------------------------------------------------------------------------
+		template<typename T>
+		job* const create_batch(void(*_function)(T*, size_t), T* const _payloads, size_t _count, counter* _counter, size_t _grainSize = 0u)
+		{
+			job_batch* const batch = new_batch(_function, _payloads, _count, _grainSize);
+
+			job* const j = create_job(nullptr, nullptr, _counter);
+			j->m_batch = batch;
+
+			return j;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Allocate a temporary array using the scheduler scratch allocator.
+		// -----------------------------------------------------------------------------------------------
+		template<typename T>
+		T* allocate(size_t _count, size_t _alignment = 16u)
+		{
+			uint8_t* mem = m_scratch->alloc(sizeof(T) * _count, _alignment);
+			return new(mem) T[_count];
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Allocate a temporary object using the scheduler scratch allocator.
+		// -----------------------------------------------------------------------------------------------
+		template<typename T>
+		T* allocate(size_t _alignment = 16u)
+		{
+			uint8_t* mem = m_scratch->alloc(sizeof(T), _alignment);
+			
+			T* obj = new(mem) T();
+			return obj;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Adds a job dependency on the specified job.
+		// -----------------------------------------------------------------------------------------------
+		void depend(job* const _target, job* const _dependency)
+		{
+			YATM_ASSERT(_dependency->m_parent == nullptr);
+
+			_dependency->m_parent = _target;
+			_target->m_pendingJobs.increment();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Sets the priority of a job. Must be called before the job is kicked.
+		// -----------------------------------------------------------------------------------------------
+		void set_priority(job* const _job, job_priority _priority)
+		{
+			YATM_ASSERT(_job != nullptr);
+			_job->m_priority = _priority;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Sets the class of a job, e.g. job_class::memory_bound for jobs limited by memory bandwidth. Must be called before the job is kicked.
+		// -----------------------------------------------------------------------------------------------
+		void set_class(job* const _job, job_class _class)
+		{
+			YATM_ASSERT(_job != nullptr);
+			_job->m_class = _class;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Declare a resource with a number of tokens, e.g. the connections of a database pool, returning its id. Jobs requesting tokens
+		// (see create_job() and set_resource()) run only while enough are left, so at most that many of them use the resource at once.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t add_resource(const char* _name, uint32_t _tokens)
+		{
+			YATM_ASSERT(_name != nullptr && _tokens > 0u && find_resource(_name) == c_noResource);
+
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			m_resources.push_back({ _name, _tokens, _tokens, 0u });
+			return (uint32_t)m_resources.size() - 1u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the id of the resource with the specified name, c_noResource if there is none.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t find_resource(const char* _name)
+		{
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			for (size_t i = 0; i < m_resources.size(); ++i)
+			{
+				if (m_resources[i].m_name == _name)
+				{
+					return (uint32_t)i;
+				}
+			}
+			return c_noResource;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return how many tokens of a resource are not taken by running jobs.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_available_tokens(uint32_t _resource)
+		{
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			YATM_ASSERT(_resource < m_resources.size());
+			return m_resources[_resource].m_available;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Sets the resource tokens a job needs to run. Must be called before the job is kicked.
+		// -----------------------------------------------------------------------------------------------
+		void set_resource(job* const _job, const resource_request& _request)
+		{
+			YATM_ASSERT(_job != nullptr);
+#if YATM_DEBUG
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				YATM_ASSERT(_request.m_resource == c_noResource || (_request.m_resource < m_resources.size() && _request.m_tokens <= m_resources[_request.m_resource].m_capacity));
+			}
+#endif // YATM_DEBUG
+			_job->m_resource = _request.m_resource;
+			_job->m_resourceTokens = _request.m_resource != c_noResource ? _request.m_tokens : 0u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Set how many memory-bound jobs may run at once, 0 for no limit. Workers left over run compute jobs meanwhile.
+		// -----------------------------------------------------------------------------------------------
+		void set_memory_bound_concurrency(uint32_t _limit)
+		{
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				m_memoryBoundLimit = _limit > 0u ? _limit : ~0u;
+				requeue_capped_jobs();
+			}
+			m_queueConditionVar.notify_all();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Set how many workers may run background jobs at once, 0 for no limit.
+		// -----------------------------------------------------------------------------------------------
+		void set_max_background_workers(uint32_t _limit)
+		{
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				m_backgroundLimit = _limit > 0u ? _limit : ~0u;
+			}
+			m_queueConditionVar.notify_all();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if a long running background job should stop at this safe point, e.g. saving its progress and resubmitting itself,
+		// because other jobs are ready to start. Jobs waiting for their dependencies, the memory-bound limit or resource tokens don't count,
+		// as preempting wouldn't let them start. Cheap enough to call often: a single relaxed load unless a foreground job is ready; always
+		// false outside of background jobs.
+		// -----------------------------------------------------------------------------------------------
+		bool should_preempt()
+		{
+			const job* const current_job = get_worker_identity().m_currentJob;
+			if (current_job == nullptr || current_job->m_priority != job_priority::background || m_numReadyForeground.get_current_relaxed() == 0u)
+			{
+				return false;
+			}
+
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			return m_numReadyForeground.get_current() > get_num_capped_jobs();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Tell the scheduler that the calling worker is about to block, e.g. in a read() or a sleep, until end_blocking(). A spare thread
+		// is woken up, or started if there are fewer than m_maxSpareWorkers, to run jobs in the meantime, so that as many threads as
+		// there are workers keep running jobs. Calls from threads that aren't workers of the scheduler are ignored. Regions can't nest.
+		// -----------------------------------------------------------------------------------------------
+		void begin_blocking()
+		{
+			const uint32_t worker_index = get_worker_index();
+			if (worker_index == c_invalidWorker)
+			{
+				return;
+			}
+
+			// Spares are started outside of the queue lock, one at a time so that they are added in index order. The worker starting them
+			// keeps going until there is one per blocked worker, itself included, and only then enters its region; if a thread can't be
+			// started, the worker is left as it was.
+			spare_worker* spare = nullptr;
+			for (;;)
+			{
+				uint32_t spare_index = 0u;
+				{
+					scoped_lock<mutex_type> lock(&m_queueMutex);
+					YATM_ASSERT(worker_index >= m_numThreads || !m_workers[worker_index].m_isBlocking);
+
+					if (spare != nullptr)
+					{
+						m_spareWorkers.push_back(spare);
+						m_isStartingSpare = false;
+					}
+
+					if (m_isStartingSpare || m_spareWorkers.size() >= std::min(m_numBlockedWorkers + 1u, m_maxSpareWorkers))
+					{
+						m_numBlockedWorkers++;
+
+						// New affinity jobs go to other workers meanwhile, and its local queue is up for stealing.
+						if (worker_index < m_numThreads)
+						{
+							m_workers[worker_index].m_isBlocking = true;
+						}
+						break;
+					}
+
+					m_isStartingSpare = true;
+					spare_index = (uint32_t)m_spareWorkers.size();
+				}
+
+				spare = start_spare(spare_index);
+			}
+			m_spareConditionVar.notify_all();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Tell the scheduler that the calling worker is done blocking, retiring a spare once it has finished its current job.
+		// -----------------------------------------------------------------------------------------------
+		void end_blocking()
+		{
+			if (get_worker_index() == c_invalidWorker)
+			{
+				return;
+			}
+
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				YATM_ASSERT(m_numBlockedWorkers > 0u);
+				m_numBlockedWorkers--;
+
+				if (get_worker_index() < m_numThreads)
+				{
+					m_workers[get_worker_index()].m_isBlocking = false;
+				}
+			}
+
+			// Spares waiting for jobs must notice they are retired.
+			m_queueConditionVar.notify_all();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Call a function that blocks the calling worker, between begin_blocking() and end_blocking().
+		// -----------------------------------------------------------------------------------------------
+		template<typename Function>
+		void blocking_region(const Function& _function)
+		{
+			blocking_scope scope(*this);
+			_function();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Calls begin_blocking() when created and end_blocking() when destroyed, so that the region ends even if the code in it throws.
+		// -----------------------------------------------------------------------------------------------
+		class blocking_scope
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			explicit blocking_scope(basic_scheduler& _scheduler)
+				: m_scheduler(&_scheduler)
+			{
+				m_scheduler->begin_blocking();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~blocking_scope()
+			{
+				m_scheduler->end_blocking();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			blocking_scope(const blocking_scope&) = delete;
+			blocking_scope& operator=(const blocking_scope&) = delete;
+
+		private:
+			basic_scheduler*	m_scheduler;
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Measure how many workers it takes to saturate memory bandwidth: jobs copy buffers much larger than the caches with 1, 2, ...
+		// workers at once, and the smallest number reaching 90% of the best bandwidth seen becomes the memory-bound limit, which is
+		// returned. It takes a while and runs jobs, so call it when the scheduler is otherwise idle, e.g. right after init().
+		// -----------------------------------------------------------------------------------------------
+		uint32_t probe_memory_bandwidth(size_t _bytesPerJob = YATM_DEFAULT_BANDWIDTH_PROBE_SIZE)
+		{
+			const uint32_t max_jobs = std::max(1u, m_numThreads);
+			const size_t size = align(std::max<size_t>(_bytesPerJob, 4096u), YATM_CACHE_LINE_SIZE);
+
+			struct probe_job
+			{
+				job						m_job;
+				std::vector<uint8_t>	m_source;
+				std::vector<uint8_t>	m_destination;
+			};
+			std::vector<probe_job> jobs(max_jobs);
+			for (probe_job& p : jobs)
+			{
+				// Committing the pages now keeps page faults out of the measurement.
+				p.m_source.resize(size, 1u);
+				p.m_destination.resize(size, 0u);
+			}
+
+			std::vector<float> bandwidth(max_jobs + 1u, 0.0f);
+			float best = 0.0f;
+			for (uint32_t n = 1u; n <= max_jobs; ++n)
+			{
+				counter done;
+				const uint64_t start = get_time_in_us();
+				for (uint32_t i = 0; i < n; ++i)
+				{
+					init_job(&jobs[i].m_job, [](void* const _data)
+					{
+						probe_job& p = *(probe_job*)_data;
+						memcpy(p.m_destination.data(), p.m_source.data(), p.m_source.size());
+						memcpy(p.m_source.data(), p.m_destination.data(), p.m_destination.size());
+					}, &jobs[i], &done, c_noAffinity);
+					submit_job(&jobs[i].m_job);
+				}
+				wait(&done);
+
+				// Every copy reads and writes the buffer.
+				const uint64_t elapsed = std::max<uint64_t>(1u, get_time_in_us() - start);
+				bandwidth[n] = (float)(4u * size * n) / (float)elapsed;
+				best = std::max(best, bandwidth[n]);
+			}
+
+			uint32_t limit = max_jobs;
+			for (uint32_t n = 1u; n <= max_jobs; ++n)
+			{
+				if (bandwidth[n] >= 0.9f * best)
+				{
+					limit = n;
+					break;
+				}
+			}
+
+			set_memory_bound_concurrency(limit);
+			return limit;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Set the function called with every low priority job that admission control sheds, e.g. to fail the request it serves fast.
+		// It runs on the thread that kicked the job, which is then finished without running. Must be set before kicking jobs.
+		// -----------------------------------------------------------------------------------------------
+		void set_shed_callback(const std::function<void(job* const)>& _callback)
+		{
+			m_shedCallback = _callback;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if admission control is currently shedding low priority jobs, e.g. to throttle a producer. The answer may be stale by the
+		// time it's used, which is fine for a hint.
+		// -----------------------------------------------------------------------------------------------
+		bool is_shedding() const { return m_isShedding.load(std::memory_order_relaxed); }
+
+		// -----------------------------------------------------------------------------------------------
+		// Creates a parallel for loop for the specified collection, launching _function per iteration.
+		// Blocks until all are complete.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Iterator, typename Function>
+		void parallel_for(const Iterator& _begin, const Iterator& _end, const Function& _function)
+		{
+			const size_t n = std::distance(_begin, _end);
+			if (n > 0)
+			{
+				// When there is only 1 job, don't pass it through the scheduler.
+				if (n == 1)
+				{
+					_function(&(*(_begin)));
+				}
+				else
+				{
+					counter jobs_done;
+					for (uint32_t i = 0; i < n; ++i)
+					{
+						job* j = create_job(_function, &(*(_begin + i)), &jobs_done);
+					}
+
+					kick();
+					wait(&jobs_done);
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Stream a file through the workers: the file is memory-mapped and split into blocks, each block is processed by a job and
+		// the results are handed to _output on the calling thread, in file order.
+		//
+		// Blocks are adjusted so that every record (ending with the record delimiter) is processed by the block it starts in; the calling
+		// thread finds the boundaries as it dispatches blocks, scanning every byte at most once. A record longer than a block extends its
+		// block, and the blocks it covers are left empty. At most m_windowInBlocks blocks are in flight; their results live in a reorder buffer of as many strings, which are reused,
+		// so memory use doesn't depend on the file size. The I/O backend maps the file; the kernel is asked to read ahead of the workers
+		// and consumed pages are dropped.
+		//
+		// _process(const char* _begin, size_t _size, std::string& _result) runs on the workers.
+		// _output(const std::string& _result, uint64_t _blockIndex) runs on the calling thread, which processes jobs while waiting.
+		// Returns false if the file can't be opened or mapped, or if the I/O backend can't map files.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Process, typename Output>
+		bool stream_file(const stream_file_desc& _desc, const Process& _process, const Output& _output)
+		{
+			YATM_ASSERT(_desc.m_path != nullptr && _desc.m_blockSizeInBytes > 0u && _desc.m_windowInBlocks > 0u);
+
+			const char* mapping = nullptr;
+			size_t file_size = 0u;
+			if (!io_backend::map_file(_desc.m_path, mapping, file_size))
+			{
+				return false;
+			}
+			if (file_size == 0u)
+			{
+				return true;
+			}
+			io_backend::advise(mapping, file_size, io_advice::sequential);
+
+			const char* const base = mapping;
+			const size_t block_size = _desc.m_blockSizeInBytes;
+			const uint64_t num_blocks = (file_size + block_size - 1u) / block_size;
+			const size_t page_size = io_backend::get_page_size();
+			const char delimiter = _desc.m_recordDelimiter;
+
+			// A slot of the reorder buffer, owning the job processing the block and its result.
+			struct stream_slot
+			{
+				job			m_job;
+				counter		m_done;
+				size_t		m_begin;
+				size_t		m_end;
+				std::string	m_result;
+			};
+			std::vector<stream_slot> slots(_desc.m_windowInBlocks);
+
+			// Start of the first record that starts at or after the specified offset.
+			auto record_start = [base, file_size, delimiter](size_t _offset) -> size_t
+			{
+				if (_offset == 0u || _offset >= file_size)
+				{
+					return std::min(_offset, file_size);
+				}
+
+				const void* const d = memchr(base + _offset - 1u, delimiter, file_size - (_offset - 1u));
+				return d != nullptr ? (size_t)((const char*)d - base) + 1u : file_size;
+			};
+
+			auto advise = [base, file_size, block_size, page_size](uint64_t _firstBlock, uint64_t _lastBlock, io_advice _advice)
+			{
+				const size_t begin = (size_t)std::min<uint64_t>(_firstBlock * block_size, file_size) & ~(page_size - 1u);
+				const size_t end = (size_t)std::min<uint64_t>(_lastBlock * block_size, file_size);
+				if (end > begin)
+				{
+					io_backend::advise(base + begin, end - begin, _advice);
+				}
+			};
+
+			// The slot jobs are set up once and re-armed for every block they process.
+			auto process_block = [base, &_process](void* const _data)
+			{
+				stream_slot& slot = *(stream_slot*)_data;
+
+				slot.m_result.clear();
+				if (slot.m_end > slot.m_begin)
+				{
+					_process(base + slot.m_begin, slot.m_end - slot.m_begin, slot.m_result);
+				}
+			};
+
+			for (stream_slot& slot : slots)
+			{
+				init_job(&slot.m_job, process_block, &slot, &slot.m_done, c_noAffinity);
+			}
+
+			uint64_t next_dispatch = 0u;
+			uint64_t next_output = 0u;
+			size_t next_begin = 0u;
+			advise(0u, _desc.m_readAheadInBlocks, io_advice::will_need);
+
+			while (next_output < num_blocks)
+			{
+				// Keep the window full.
+				while (next_dispatch < num_blocks && next_dispatch - next_output < _desc.m_windowInBlocks)
+				{
+					// Blocks start where the previous one ended; the scan for the end of this one starts after what was already scanned.
+					stream_slot& slot = slots[next_dispatch % _desc.m_windowInBlocks];
+					slot.m_begin = next_begin;
+					slot.m_end = record_start(std::max<size_t>(next_begin, (size_t)((next_dispatch + 1u) * block_size)));
+					next_begin = slot.m_end;
+
+					// The slot's previous job has finished, give it its pending count back.
+					if (next_dispatch >= _desc.m_windowInBlocks)
+					{
+						slot.m_job.m_pendingJobs.increment();
+					}
+					submit_job(&slot.m_job);
+
+					advise(next_dispatch + _desc.m_readAheadInBlocks, next_dispatch + _desc.m_readAheadInBlocks + 1u, io_advice::will_need);
+					next_dispatch++;
+				}
+
+				// Results are handed out strictly in order; later blocks wait in the reorder buffer.
+				stream_slot& slot = slots[next_output % _desc.m_windowInBlocks];
+				wait(&slot.m_done);
+				_output((const std::string&)slot.m_result, next_output);
+
+				// The pages of the previous block won't be read again, later blocks start at or after their nominal offset.
+				if (next_output > 0u)
+				{
+					advise(next_output - 1u, next_output, io_advice::dont_need);
+				}
+				next_output++;
+			}
+
+			io_backend::unmap_file(mapping, file_size);
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Register a file descriptor with the reactor: whenever it becomes ready for any of _events (EPOLLIN, EPOLLOUT, ... with the
+		// epoll backend), _callback(int _fd, uint32_t _readyEvents) runs as a job. There is no separate event thread; an idle worker
+		// blocks in the I/O backend's poller and queues the ready fds in its own local queue, so dispatching takes no extra lock or wake-up.
+		// The fd is one-shot: it is armed again only after its callback returns, so a callback never runs concurrently with itself.
+		// Requires worker threads. Returns nullptr if the fd can't be watched, or if the I/O backend has no reactor.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Function>
+		reactor_registration* register_fd(int _fd, uint32_t _events, const Function& _callback)
+		{
+			YATM_ASSERT(_fd >= 0 && m_numThreads > 0u);
+
+			reactor_registration* const r = new reactor_registration();
+			r->m_callback = _callback;
+			r->m_fd = _fd;
+			r->m_events = _events;
+			r->m_isRegistered = true;
+
+			// The job is re-armed for every event, it starts without any pending work.
+			init_job(&r->m_job, [this](void* const _data) { dispatch_registration((reactor_registration*)_data); }, r, nullptr, c_noAffinity);
+			r->m_job.m_pendingJobs.decrement();
+
+			scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+
+			if (!io_backend::watch(m_reactorPollFd, _fd, _events, r))
+			{
+				delete r;
+				return nullptr;
+			}
+			m_reactorRegistrations.push_back(r);
+
+			// If no worker is polling yet, one needs to take it up.
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				m_numReactorRegistrations++;
+			}
+			m_queueConditionVar.notify_one();
+
+			return r;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove a file descriptor from the reactor. Once this returns, its callback isn't running and won't start again, so the fd can be
+		// closed; a callback that is running is waited for, unless it's the caller. Callbacks of two registrations mustn't unregister each
+		// other. The registration is freed by the scheduler; the fd is left open.
+		// -----------------------------------------------------------------------------------------------
+		void unregister_fd(reactor_registration* const _registration)
+		{
+			YATM_ASSERT(_registration != nullptr);
+
+			{
+				scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+				if (!_registration->m_isRegistered)
+				{
+					return;
+				}
+
+				io_backend::unwatch(m_reactorPollFd, _registration->m_fd);
+				_registration->m_isRegistered = false;
+
+				m_reactorRegistrations.erase(std::find(m_reactorRegistrations.begin(), m_reactorRegistrations.end(), _registration));
+				m_retiredRegistrations.push_back(_registration);
+
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				m_numReactorRegistrations--;
+			}
+
+			// The registration can't be freed while its job is running, which includes a callback calling this.
+			if (get_worker_identity().m_currentJob == &_registration->m_job)
+			{
+				return;
+			}
+
+			for (;;)
+			{
+				{
+					scoped_lock<mutex_type> reactor_lock(&m_reactorMutex);
+					if (!_registration->m_isInCallback)
+					{
+						return;
+					}
+				}
+				thread_backend::yield();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Let idle workers run jobs from a job pool shared with other processes, resolving function ids through the registry. A worker with
+		// nothing else to do waits up to _timeoutInMs for a pool job before checking its queues again. Pass nullptr to detach the pool;
+		// the pool and registry must outlive their attachment. Requires an I/O backend with a shared pool.
+		// -----------------------------------------------------------------------------------------------
+		void attach_shared_pool(shared_pool_type* const _pool, const function_registry_type* const _registry, uint32_t _timeoutInMs = YATM_DEFAULT_SHARED_POOL_TIMEOUT_MS)
+		{
+			YATM_ASSERT(_pool == nullptr || (_pool->is_open() && _registry != nullptr));
+
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+
+				// Wait for the worker using the current pool to be done with it.
+				while (m_isSharedPoolWaiting)
+				{
+					m_sharedPool->notify_all();
+					lock.unlock();
+					thread_backend::yield();
+					lock.lock();
+				}
+
+				m_sharedPool = _pool;
+				m_sharedRegistry = _registry;
+				m_sharedPoolTimeoutInMs = std::max(1u, _timeoutInMs);
+			}
+			m_queueConditionVar.notify_one();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Signal the worker threads that work has been added.
+		// -----------------------------------------------------------------------------------------------
+		void kick()
+		{
+			// Add the pending jobs to the global job queue and notify the worker threads that work has been added.
+			scoped_lock<mutex_type> lock(&m_pendingJobsMutex);
+
+#if YATM_DEBUG
+			verify_job_graph();
+#endif // YATM_DEBUG
+
+			publish_jobs(m_pendingJobsToAdd.data(), m_pendingJobsToAdd.size());
+			m_pendingJobsToAdd.clear();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Buffers the jobs created through it privately, so that its own kick() publishes them and nothing else. Unlike with the
+		// scheduler's create_job() and kick(), a thread building a graph with a context can't have it published half wired by another
+		// thread's kick(), and producers building graphs concurrently don't contend on the scheduler's pending jobs. Jobs are allocated
+		// from the scheduler scratch allocator and set up with the scheduler (depend(), set_priority(), ...) as usual; dependencies may
+		// cross contexts. Each producer uses its own context, which is not thread safe; jobs not kicked yet are kicked on destruction.
+		// -----------------------------------------------------------------------------------------------
+		class submission_context
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			explicit submission_context(basic_scheduler& _scheduler)
+				: m_scheduler(&_scheduler)
+			{
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~submission_context()
+			{
+				kick();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			submission_context(const submission_context&) = delete;
+			submission_context& operator=(const submission_context&) = delete;
+
+			// -----------------------------------------------------------------------------------------------
+			// Create a job in this context, see scheduler::create_job().
+			// -----------------------------------------------------------------------------------------------
+			template<typename Function>
+			job* const create_job(const Function& _function, void* const _data, counter* _counter, uint64_t _affinity = c_noAffinity)
+			{
+				job* const j = m_scheduler->template allocate<job>();
+				m_scheduler->init_job(j, _function, _data, _counter, _affinity);
+				m_jobs.push_back(j);
+				return j;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Create a job needing resource tokens in this context, see scheduler::create_job().
+			// -----------------------------------------------------------------------------------------------
+			template<typename Function>
+			job* const create_job(const Function& _function, void* const _data, counter* _counter, const resource_request& _request)
+			{
+				job* const j = create_job(_function, _data, _counter);
+				m_scheduler->set_resource(j, _request);
+				return j;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Create a group in this context, see scheduler::create_group().
+			// -----------------------------------------------------------------------------------------------
+			job* const create_group(job* const _parent = nullptr)
+			{
+				job* const group = create_job(nullptr, nullptr, nullptr);
+				if (_parent != nullptr)
+				{
+					m_scheduler->depend(_parent, group);
+				}
+				return group;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Create a batch job in this context, see scheduler::create_batch().
+			// -----------------------------------------------------------------------------------------------
+			template<typename T>
+			job* const create_batch(void(*_function)(T*, size_t), T* const _payloads, size_t _count, counter* _counter, size_t _grainSize = 0u)
+			{
+				job_batch* const batch = m_scheduler->new_batch(_function, _payloads, _count, _grainSize);
+
+				job* const j = create_job(nullptr, nullptr, _counter);
+				j->m_batch = batch;
+
+				return j;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Publish the jobs created in this context since the last kick, under a single lock.
+			// -----------------------------------------------------------------------------------------------
+			void kick()
+			{
+				if (!m_jobs.empty())
+				{
+					m_scheduler->publish_jobs(m_jobs.data(), m_jobs.size());
+					m_jobs.clear();
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of jobs waiting for the next kick.
+			// -----------------------------------------------------------------------------------------------
+			size_t get_num_pending() const { return m_jobs.size(); }
+
+		private:
+			basic_scheduler*	m_scheduler;
+			std::vector<job*>	m_jobs;
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Builds a large job graph from many threads at once, to be launched as one unit. Each thread adds nodes through an arena of its
+		// own, which takes jobs from the scheduler scratch allocator a chunk at a time, so threads don't contend on its lock. Edges can be
+		// added from any thread without locking: a dependency has a single parent and the target's pending count is atomic. Once every
+		// builder thread is done, finalize() gathers the nodes of all arenas in parallel on the scheduler, and launch() publishes them
+		// under a single queue lock.
+		// -----------------------------------------------------------------------------------------------
+		class graph_builder
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			// Adds nodes for a single thread.
+			// -----------------------------------------------------------------------------------------------
+			class arena
+			{
+			public:
+				// -----------------------------------------------------------------------------------------------
+				arena(basic_scheduler& _scheduler, uint32_t _chunkSize)
+					: m_scheduler(&_scheduler), m_chunkSize(_chunkSize), m_numInLastChunk(0u)
+				{
+				}
+
+				// -----------------------------------------------------------------------------------------------
+				arena(const arena&) = delete;
+				arena& operator=(const arena&) = delete;
+
+				// -----------------------------------------------------------------------------------------------
+				// Add a node to the graph, see scheduler::create_job().
+				// -----------------------------------------------------------------------------------------------
+				template<typename Function>
+				job* const add_node(const Function& _function, void* const _data, counter* _counter, uint64_t _affinity = c_noAffinity)
+				{
+					if (m_chunks.empty() || m_numInLastChunk == m_chunkSize)
+					{
+						m_chunks.push_back(m_scheduler->template allocate<job>(m_chunkSize, YATM_CACHE_LINE_SIZE));
+						m_numInLastChunk = 0u;
+					}
+
+					job* const j = &m_chunks.back()[m_numInLastChunk++];
+					m_scheduler->init_job(j, _function, _data, _counter, _affinity);
+					return j;
+				}
+
+				// -----------------------------------------------------------------------------------------------
+				// Return the number of nodes added through this arena.
+				// -----------------------------------------------------------------------------------------------
+				size_t get_num_nodes() const { return m_chunks.empty() ? 0u : (m_chunks.size() - 1u) * m_chunkSize + m_numInLastChunk; }
+
+			private:
+				friend class graph_builder;
+
+				basic_scheduler*	m_scheduler;
+				std::vector<job*>	m_chunks;
+				uint32_t			m_chunkSize;
+				uint32_t			m_numInLastChunk;
+			};
+
+			// -----------------------------------------------------------------------------------------------
+			graph_builder(basic_scheduler& _scheduler, uint32_t _chunkSize = YATM_DEFAULT_GRAPH_ARENA_CHUNK_SIZE)
+				: m_scheduler(&_scheduler), m_chunkSize(std::max(1u, _chunkSize))
+			{
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~graph_builder()
+			{
+				for (arena* const a : m_arenas)
+				{
+					delete a;
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			graph_builder(const graph_builder&) = delete;
+			graph_builder& operator=(const graph_builder&) = delete;
+
+			// -----------------------------------------------------------------------------------------------
+			// Create an arena for the calling thread to add nodes with. Thread safe.
+			// -----------------------------------------------------------------------------------------------
+			arena& create_arena()
+			{
+				scoped_lock<mutex_type> lock(&m_arenasMutex);
+				m_arenas.push_back(new arena(*m_scheduler, m_chunkSize));
+				return *m_arenas.back();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Make a node depend on another one, from any thread. A node can only be the dependency of a single node.
+			// -----------------------------------------------------------------------------------------------
+			void add_edge(job* const _target, job* const _dependency)
+			{
+				m_scheduler->depend(_target, _dependency);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Gather the nodes of every arena for launch(), one job per arena. Builder threads must be done adding nodes and edges.
+			// -----------------------------------------------------------------------------------------------
+			void finalize()
+			{
+				std::vector<size_t> offsets(m_arenas.size());
+				size_t num_nodes = 0u;
+				for (size_t i = 0; i < m_arenas.size(); ++i)
+				{
+					offsets[i] = num_nodes;
+					num_nodes += m_arenas[i]->get_num_nodes();
+				}
+				m_nodes.resize(num_nodes);
+
+				// A context of its own, so that a kick from another thread doesn't publish the graph with the gathering jobs.
+				counter gathered;
+				{
+					submission_context context(*m_scheduler);
+					for (size_t i = 0; i < m_arenas.size(); ++i)
+					{
+						context.create_job([this, &offsets, i](void* const) { gather(*m_arenas[i], m_nodes.data() + offsets[i]); }, nullptr, &gathered);
+					}
+				}
+				m_scheduler->wait(&gathered);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Publish the finalized graph. The builder can be reused afterwards, with new arenas.
+			// -----------------------------------------------------------------------------------------------
+			void launch()
+			{
+				if (!m_nodes.empty())
+				{
+					m_scheduler->publish_jobs(m_nodes.data(), m_nodes.size());
+				}
+
+				for (arena* const a : m_arenas)
+				{
+					delete a;
+				}
+				m_arenas.clear();
+				m_nodes.clear();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of nodes gathered by finalize().
+			// -----------------------------------------------------------------------------------------------
+			size_t get_num_nodes() const { return m_nodes.size(); }
+
+		private:
+			basic_scheduler*	m_scheduler;
+			uint32_t			m_chunkSize;
+			mutex_type			m_arenasMutex;
+			std::vector<arena*>	m_arenas;
+			std::vector<job*>	m_nodes;
+
+			// -----------------------------------------------------------------------------------------------
+			static void gather(const arena& _arena, job** _nodes)
+			{
+				for (size_t c = 0; c < _arena.m_chunks.size(); ++c)
+				{
+					const uint32_t count = c + 1u < _arena.m_chunks.size() ? _arena.m_chunkSize : _arena.m_numInLastChunk;
+					for (uint32_t i = 0; i < count; ++i)
+					{
+						*_nodes++ = &_arena.m_chunks[c][i];
+					}
+				}
+			}
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Coalesces the jobs submitted by one producer thread, and hands them to the scheduler a batch at a time, under a single lock and
+		// with a single round of notifications. A batch is flushed when it reaches _maxBatchSize jobs or when its oldest job has waited
+		// _maxDelayInUs, whichever comes first: an idle worker flushes batches that waited long enough, so a lone job isn't held back
+		// until the next submit. Each producer uses its own batcher.
+		//
+		// With _flushWhenIdle = false, the delay is only checked when submitting, and producers should call flush() (or flush_if_expired())
+		// before going idle; use it to set up dependencies between submitted jobs, which is only safe until their batch is flushed. The
+		// scheduler must have worker threads for idle flushing.
+		// -----------------------------------------------------------------------------------------------
+		class submission_batcher
+		{
+			friend class basic_scheduler;
+		public:
+			// -----------------------------------------------------------------------------------------------
+			submission_batcher(basic_scheduler& _scheduler, uint32_t _maxBatchSize = YATM_DEFAULT_BATCH_SIZE, uint32_t _maxDelayInUs = YATM_DEFAULT_BATCH_DELAY_US, bool _flushWhenIdle = true)
+				: m_scheduler(&_scheduler), m_maxBatchSize(std::max(1u, _maxBatchSize)), m_maxDelayInUs(_maxDelayInUs), m_oldestJobTimeInUs(0u), m_flushWhenIdle(_flushWhenIdle)
+			{
+				m_jobs.reserve(m_maxBatchSize);
+
+				if (m_flushWhenIdle)
+				{
+					scoped_lock<mutex_type> lock(&m_scheduler->m_batchersMutex);
+					m_scheduler->m_batchers.push_back(this);
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~submission_batcher()
+			{
+				if (m_flushWhenIdle)
+				{
+					scoped_lock<mutex_type> lock(&m_scheduler->m_batchersMutex);
+					m_scheduler->m_batchers.erase(std::find(m_scheduler->m_batchers.begin(), m_scheduler->m_batchers.end(), this));
+				}
+
+				flush();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			submission_batcher(const submission_batcher&) = delete;
+			submission_batcher& operator=(const submission_batcher&) = delete;
+
+			// -----------------------------------------------------------------------------------------------
+			// Create a job from the scheduler scratch allocator and add it to the current batch, flushing the batch if it's full or too old.
+			// Dependencies may be set up until the batch is flushed, which with idle flushing can happen as soon as this returns. The job
+			// counts in _counter from now on, so a wait on it covers jobs still in the batch; without idle flushing, flush before waiting.
+			// -----------------------------------------------------------------------------------------------
+			template<typename Function>
+			job* const submit(const Function& _function, void* const _data, counter* _counter, uint64_t _affinity = c_noAffinity)
+			{
+				job* const j = m_scheduler->template allocate<job>();
+				m_scheduler->init_job(j, _function, _data, _counter, _affinity);
+				if (_counter != nullptr)
+				{
+					_counter->increment();
+				}
+
+				scoped_lock<mutex_type> lock(&m_mutex);
+				const uint64_t now = get_time_in_us();
+				const bool is_new_batch = m_jobs.empty();
+				if (is_new_batch)
+				{
+					m_oldestJobTimeInUs = now;
+				}
+				m_jobs.push_back(j);
+
+				if (m_jobs.size() >= m_maxBatchSize)
+				{
+					flush_batch(m_stats.m_sizeFlushes);
+				}
+				else if (now - m_oldestJobTimeInUs >= m_maxDelayInUs)
+				{
+					flush_batch(m_stats.m_timeFlushes);
+				}
+				else if (is_new_batch && m_flushWhenIdle)
+				{
+					m_scheduler->arm_batch_deadline(m_oldestJobTimeInUs + m_maxDelayInUs);
+				}
+
+				return j;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Hand the current batch to the scheduler.
+			// -----------------------------------------------------------------------------------------------
+			void flush()
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				flush_batch(m_stats.m_explicitFlushes);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Hand the current batch to the scheduler if its oldest job has waited long enough, e.g. from a producer's idle loop.
+			// -----------------------------------------------------------------------------------------------
+			void flush_if_expired()
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				if (!m_jobs.empty() && get_time_in_us() - m_oldestJobTimeInUs >= m_maxDelayInUs)
+				{
+					flush_batch(m_stats.m_timeFlushes);
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of jobs waiting in the current batch.
+			// -----------------------------------------------------------------------------------------------
+			size_t get_batch_size() const
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				return m_jobs.size();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the batch size and flush reason statistics.
+			// -----------------------------------------------------------------------------------------------
+			batcher_stats get_stats() const
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				return m_stats;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Reset the statistics.
+			// -----------------------------------------------------------------------------------------------
+			void reset_stats()
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				m_stats = batcher_stats();
+			}
+
+		private:
+			basic_scheduler*	m_scheduler;
+			mutable mutex_type	m_mutex;				// Taken by idle workers flushing the batch, locked before the queue mutex.
+			std::vector<job*>	m_jobs;
+			uint32_t			m_maxBatchSize;
+			uint32_t			m_maxDelayInUs;
+			uint64_t			m_oldestJobTimeInUs;
+			bool				m_flushWhenIdle;
+			batcher_stats		m_stats;
+
+			// -----------------------------------------------------------------------------------------------
+			// Called by an idle worker: flush the batch if it waited long enough, otherwise have a worker come back when it has.
+			// -----------------------------------------------------------------------------------------------
+			void flush_expired()
+			{
+				scoped_lock<mutex_type> lock(&m_mutex);
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				if (get_time_in_us() - m_oldestJobTimeInUs >= m_maxDelayInUs)
+				{
+					flush_batch(m_stats.m_timeFlushes);
+				}
+				else
+				{
+					m_scheduler->arm_batch_deadline(m_oldestJobTimeInUs + m_maxDelayInUs);
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			void flush_batch(uint64_t& _reason)
+			{
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				// The jobs were counted when they were submitted.
+				m_scheduler->publish_jobs(m_jobs.data(), m_jobs.size(), true);
+
+				_reason++;
+				m_stats.m_batches++;
+				m_stats.m_jobs += m_jobs.size();
+				m_stats.m_maxBatchSize = std::max(m_stats.m_maxBatchSize, (uint32_t)m_jobs.size());
+				m_jobs.clear();
+			}
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Runs the functions posted to it one at a time, in the order they were posted, on the scheduler workers; different strands run
+		// in parallel. Useful for objects whose operations must not overlap but don't need a thread of their own.
+		//
+		// Posting pushes onto a lock-free multi-producer queue; the first post to an idle strand submits its drain job, which runs up to
+		// _itemsPerDispatch items back to back while they are hot in cache, then resubmits itself if more are left so that other jobs get
+		// a turn. Items are allocated from the scheduler scratch allocator, so the scheduler must not be reset while any are posted.
+		// The strand must outlive its items.
+		// -----------------------------------------------------------------------------------------------
+		class strand
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			strand(basic_scheduler& _scheduler, uint32_t _itemsPerDispatch = YATM_DEFAULT_STRAND_ITEMS_PER_DISPATCH)
+				: m_scheduler(&_scheduler), m_head(&m_stub), m_itemsPerDispatch(std::max(1u, _itemsPerDispatch)), m_nextJob(0u)
+			{
+				store(m_stub.m_next, nullptr);
+				store(m_tail, &m_stub);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			~strand()
+			{
+				while (m_numItems.get_current() > 0u || !m_jobs[0].m_pendingJobs.is_done() || !m_jobs[1].m_pendingJobs.is_done())
+				{
+					thread_backend::yield();
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			strand(const strand&) = delete;
+			strand& operator=(const strand&) = delete;
+
+			// -----------------------------------------------------------------------------------------------
+			// Post a function to run after the ones posted before it. The counter is incremented now and decremented once it has run.
+			// Can be called from any thread, including from items of this strand.
+			// -----------------------------------------------------------------------------------------------
+			template<typename Function>
+			void post(const Function& _function, void* const _data, counter* _counter = nullptr)
+			{
+				item* const i = m_scheduler->template allocate<item>();
+				i->m_function = _function;
+				i->m_data = _data;
+				i->m_counter = _counter;
+				if (_counter != nullptr)
+				{
+					_counter->increment();
+				}
+
+				push(i);
+
+				// Only the post that makes the strand busy dispatches it; the drain job takes care of the others.
+				if (m_numItems.increment() == 1u)
+				{
+					dispatch();
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of items posted that haven't finished running.
+			// -----------------------------------------------------------------------------------------------
+			uint32_t get_num_items() const { return m_numItems.get_current(); }
+
+		private:
+			struct item;
+#if YATM_STD_THREAD
+			using atomic_type = std::atomic<item*>;
+#elif YATM_WIN64
+			using atomic_type = item* volatile;
+#endif // YATM_STD_THREAD
+
+			struct item
+			{
+				job::JobFuncPtr	m_function;
+				void*			m_data;
+				counter*		m_counter;
+				atomic_type		m_next;
+			};
+
+			basic_scheduler*							m_scheduler;
+			alignas(YATM_CACHE_LINE_SIZE) atomic_type	m_tail;				// Last item posted, swapped by producers.
+			alignas(YATM_CACHE_LINE_SIZE) item*			m_head;				// Only touched by the drain job.
+			item										m_stub;
+			counter										m_numItems;			// Items posted that haven't finished running.
+			job											m_jobs[2];			// The drain job resubmits itself before it has finished, so it alternates between two.
+			uint32_t									m_itemsPerDispatch;
+			uint32_t									m_nextJob;
+
+			// -----------------------------------------------------------------------------------------------
+			// Submit the drain job. Dispatches never overlap: the next one happens either from the running drain job, or from a post after
+			// it has run its last item.
+			// -----------------------------------------------------------------------------------------------
+			void dispatch()
+			{
+				job* const j = &m_jobs[m_nextJob];
+				m_nextJob ^= 1u;
+
+				// The job submitted two dispatches ago has run, but the worker may still be finishing it.
+				while (!j->m_pendingJobs.is_done())
+				{
+					thread_backend::yield();
+				}
+
+				m_scheduler->init_job(j, [this](void* const) { drain(); }, nullptr, nullptr, c_noAffinity);
+				m_scheduler->submit_job(j);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Run up to m_itemsPerDispatch items, then dispatch again if any are left.
+			// -----------------------------------------------------------------------------------------------
+			void drain()
+			{
+				for (uint32_t n = 0; n < m_itemsPerDispatch; ++n)
+				{
+					item* const i = pop();
+					i->m_function(i->m_data);
+					if (i->m_counter != nullptr)
+					{
+						i->m_counter->decrement();
+					}
+
+					if (m_numItems.decrement() == 0u)
+					{
+						return;
+					}
+				}
+
+				dispatch();
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Append an item; wait-free, see Vyukov's intrusive MPSC queue.
+			// -----------------------------------------------------------------------------------------------
+			void push(item* const _item)
+			{
+				store(_item->m_next, nullptr);
+				item* const previous = exchange(m_tail, _item);
+				store(previous->m_next, _item);
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Remove the oldest item. The item count guarantees there is one, but a producer may not have linked it yet, in which case
+			// this waits for it.
+			// -----------------------------------------------------------------------------------------------
+			item* pop()
+			{
+				for (;;)
+				{
+					item* head = m_head;
+					item* next = load(head->m_next);
+					if (head == &m_stub)
+					{
+						if (next == nullptr)
+						{
+							thread_backend::yield();
+							continue;
+						}
+						m_head = next;
+						head = next;
+						next = load(next->m_next);
+					}
+
+					if (next != nullptr)
+					{
+						m_head = next;
+						return head;
+					}
+
+					// The head is the last item linked; put the stub behind it so that it can be removed.
+					if (head == load(m_tail))
+					{
+						push(&m_stub);
+						next = load(head->m_next);
+						if (next != nullptr)
+						{
+							m_head = next;
+							return head;
+						}
+					}
+
+					thread_backend::yield();
+				}
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Atomic operations: loads acquire, stores release, exchanges are sequentially consistent.
+			// -----------------------------------------------------------------------------------------------
+			static item* load(const atomic_type& _value)
+			{
+#if YATM_STD_THREAD
+				return _value.load(std::memory_order_acquire);
+#elif YATM_WIN64
+				return (item*)_value;
+#endif // YATM_STD_THREAD
+			}
+
+			static void store(atomic_type& _value, item* _newValue)
+			{
+#if YATM_STD_THREAD
+				_value.store(_newValue, std::memory_order_release);
+#elif YATM_WIN64
+				InterlockedExchangePointer((PVOID volatile*)&_value, _newValue);
+#endif // YATM_STD_THREAD
+			}
+
+			static item* exchange(atomic_type& _value, item* _newValue)
+			{
+#if YATM_STD_THREAD
+				return _value.exchange(_newValue);
+#elif YATM_WIN64
+				return (item*)InterlockedExchangePointer((PVOID volatile*)&_value, _newValue);
+#endif // YATM_STD_THREAD
+			}
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// A persistent job graph relaunched every tick, which only reruns the nodes whose inputs changed. Each node declares a hash (or
+		// version) of the inputs it reads, beside the outputs of the nodes it depends on; launch() dispatches the nodes whose hash differs
+		// from the one they last ran with, and the nodes depending on those, directly or not. The other nodes are skipped and their outputs,
+		// kept by the caller in the node data, are reused.
+		//
+		// Like jobs, a node has a single parent, so graphs are forests. Nodes can't be added while the graph is running.
+		// -----------------------------------------------------------------------------------------------
+		class incremental_graph
+		{
+		public:
+			// -----------------------------------------------------------------------------------------------
+			explicit incremental_graph(basic_scheduler& _scheduler)
+				: m_scheduler(&_scheduler), m_numDispatched(0u)
+			{
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			incremental_graph(const incremental_graph&) = delete;
+			incremental_graph& operator=(const incremental_graph&) = delete;
+
+			// -----------------------------------------------------------------------------------------------
+			// Add a node, returning its id. It runs on the first launch.
+			// -----------------------------------------------------------------------------------------------
+			template<typename Function>
+			uint32_t add_node(const Function& _function, void* const _data)
+			{
+				node n;
+				n.m_function = _function;
+				n.m_data = _data;
+				m_nodes.push_back(n);
+				return (uint32_t)m_nodes.size() - 1u;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Make a node read the output of another one: it runs after it, and reruns whenever it does.
+			// -----------------------------------------------------------------------------------------------
+			void depend(uint32_t _target, uint32_t _dependency)
+			{
+				YATM_ASSERT(_target < m_nodes.size() && _dependency < m_nodes.size() && _target != _dependency);
+				YATM_ASSERT(m_nodes[_dependency].m_parent == c_noNode);
+				m_nodes[_dependency].m_parent = _target;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Set the hash of the inputs a node reads for the next launch, e.g. with hash() or a version number bumped on every change.
+			// -----------------------------------------------------------------------------------------------
+			void set_input_hash(uint32_t _node, uint64_t _hash)
+			{
+				YATM_ASSERT(_node < m_nodes.size());
+				m_nodes[_node].m_inputHash = _hash;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Force a node to run on the next launch, whatever its inputs.
+			// -----------------------------------------------------------------------------------------------
+			void invalidate(uint32_t _node)
+			{
+				YATM_ASSERT(_node < m_nodes.size());
+				m_nodes[_node].m_hasRun = false;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Create and kick the jobs of the nodes that need to run, returning how many there are. The counter is decremented as they
+			// finish; wait for it before launching again or changing the graph. Jobs are allocated from the scheduler scratch allocator,
+			// through a submission context so that launching publishes them and nothing else other threads are building.
+			// -----------------------------------------------------------------------------------------------
+			uint32_t launch(counter* _counter)
+			{
+				// Nodes whose inputs changed are dirty, and so is every node that depends on them.
+				for (node& n : m_nodes)
+				{
+					n.m_job = nullptr;
+					n.m_isDirty = false;
+				}
+
+				for (node& n : m_nodes)
+				{
+					if (n.m_hasRun && n.m_inputHash == n.m_ranHash)
+					{
+						continue;
+					}
+
+					for (node* d = &n; d != nullptr && !d->m_isDirty; d = d->m_parent != c_noNode ? &m_nodes[d->m_parent] : nullptr)
+					{
+						d->m_isDirty = true;
+					}
+				}
+
+				// Only the dirty cone is dispatched; a dirty node waits for its dirty dependencies, the others have their outputs already.
+				submission_context context(*m_scheduler);
+				m_numDispatched = 0u;
+				for (node& n : m_nodes)
+				{
+					if (n.m_isDirty)
+					{
+						n.m_job = context.create_job(&run_node, &n, _counter);
+						m_numDispatched++;
+					}
+				}
+
+				for (node& n : m_nodes)
+				{
+					if (n.m_isDirty && n.m_parent != c_noNode)
+					{
+						m_scheduler->depend(m_nodes[n.m_parent].m_job, n.m_job);
+					}
+				}
+
+				context.kick();
+				return m_numDispatched;
+			}
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of nodes the last launch dispatched.
+			// -----------------------------------------------------------------------------------------------
+			uint32_t get_num_dispatched() const { return m_numDispatched; }
+
+			// -----------------------------------------------------------------------------------------------
+			// Return the number of nodes in the graph.
+			// -----------------------------------------------------------------------------------------------
+			uint32_t get_num_nodes() const { return (uint32_t)m_nodes.size(); }
+
+			// -----------------------------------------------------------------------------------------------
+			// Hash a block of memory (FNV-1a), to derive input hashes from plain data. Chain calls through _seed to hash several blocks.
+			// -----------------------------------------------------------------------------------------------
+			static uint64_t hash(const void* const _data, size_t _size, uint64_t _seed = 0xcbf29ce484222325ull)
+			{
+				const uint8_t* const bytes = (const uint8_t*)_data;
+				for (size_t i = 0; i < _size; ++i)
+				{
+					_seed ^= bytes[i];
+					_seed *= 0x100000001b3ull;
+				}
+				return _seed;
+			}
+
+		private:
+			static constexpr uint32_t c_noNode = ~0u;
+
+			struct node
+			{
+				job::JobFuncPtr	m_function;
+				void*			m_data = nullptr;
+				uint32_t		m_parent = c_noNode;
+				uint64_t		m_inputHash = 0u;
+				uint64_t		m_ranHash = 0u;			// Input hash the node last ran with.
+				bool			m_hasRun = false;
+				bool			m_isDirty = false;
+				job*			m_job = nullptr;		// Job of the current launch, nullptr if the node is clean.
+			};
+
+			basic_scheduler*	m_scheduler;
+			std::vector<node>	m_nodes;
+			uint32_t			m_numDispatched;
+
+			// -----------------------------------------------------------------------------------------------
+			// Run a dirty node and remember which inputs it ran with.
+			// -----------------------------------------------------------------------------------------------
+			static void run_node(void* const _data)
+			{
+				node& n = *(node*)_data;
+				n.m_function(n.m_data);
+				n.m_ranHash = n.m_inputHash;
+				n.m_hasRun = true;
+			}
+		};
+
+		// -----------------------------------------------------------------------------------------------
+		// Offload jobs to peer processes and serve theirs, over TCP. Defined after the scheduler, on platforms with sockets.
+		// -----------------------------------------------------------------------------------------------
+		class remote_offloader;
+		class remote_job_server;
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for a single job to complete. In the meantime, try to process one pending job.
+		// -----------------------------------------------------------------------------------------------
+		void wait(job* const _job)
+		{
+			YATM_ASSERT(_job != nullptr);
+			while (!_job->m_pendingJobs.is_done())
+			{				
+				// Process jobs while waiting
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				worker_internal(lock, get_worker_index());
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for a counter to reach 0. In the meantime, try to process one pending job.
+		// -----------------------------------------------------------------------------------------------
+		void wait(counter* const _counter)
+		{
+			YATM_ASSERT(_counter != nullptr);
+			while (!_counter->is_done())
+			{
+				// Process jobs while waiting
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				worker_internal(lock, get_worker_index());
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for a condition to become true, e.g. on state shared with other jobs. In the meantime, try to process one pending job.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Condition>
+		void wait_until(const Condition& _condition)
+		{
+			while (!_condition())
+			{
+				// Process jobs while waiting
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				worker_internal(lock, get_worker_index());
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// A yield point for long running jobs. If high priority jobs are waiting, run them on the calling thread's stack and return
+		// once none is ready; the caller then resumes its own work. When nothing is waiting, this costs a single relaxed load.
+		// -----------------------------------------------------------------------------------------------
+		void maybe_yield()
+		{
+			if (m_numReadyHighPriorityJobs.get_current_relaxed() == 0u)
+			{
+				return;
+			}
+
+			// High priority jobs don't preempt each other.
+			const job* const current_job = get_worker_identity().m_currentJob;
+			if (current_job != nullptr && current_job->m_priority == job_priority::high)
+			{
+				return;
+			}
+
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			while (job* const j = take_high_priority_job())
+			{
+				m_instrumentation.on_yield();
+
+				// This thread goes back to the job it yielded from, a parent made ready is left to the workers.
+				job* const parent = run_job(lock, j);
+				if (parent != nullptr)
+				{
+					on_job_ready(parent);
+					m_queueConditionVar.notify_one();
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Yield the current thread and allow others to execute.
+		// -----------------------------------------------------------------------------------------------
+		void yield()
+		{
+			thread_backend::yield();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the index of the calling worker thread, or c_invalidWorker if the caller is not one of this scheduler's workers.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_worker_index() const
+		{
+			const worker_identity& id = get_worker_identity();
+			return id.m_scheduler == this ? id.m_index : c_invalidWorker;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the pool of guard-paged stacks for suspendable jobs, sized from scheduler_desc::m_stackSizeInBytes. It's a
+		// null_stack_pool if the thread backend has none.
+		// -----------------------------------------------------------------------------------------------
+		stack_pool_type& get_stack_pool() { return m_stackPool; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Return a snapshot of the scheduler statistics.
+		// -----------------------------------------------------------------------------------------------
+		scheduler_stats get_stats()
+		{
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+
+			scheduler_stats stats;
+			m_instrumentation.get_stats(stats);
+			stats.m_activeThreads = m_numActiveThreads;
+			stats.m_memoryBoundConcurrency = m_memoryBoundLimit != ~0u ? m_memoryBoundLimit : 0u;
+			stats.m_blockedWorkers = m_numBlockedWorkers;
+			stats.m_spareWorkers = (uint32_t)m_spareWorkers.size();
+			stats.m_cappedJobs = get_num_capped_jobs();
+			return stats;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Reset the scheduler statistics.
+		// -----------------------------------------------------------------------------------------------
+		void reset_stats()
+		{
+			scoped_lock<mutex_type> lock(&m_queueMutex);
+			m_instrumentation.reset();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the maximum number of worker threads.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_max_threads() const { return m_hwConcurency; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if the scheduler is running worker functions.
+		// -----------------------------------------------------------------------------------------------
+		bool is_running() const { return m_isRunning; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Stop the scheduler from processing, effectively shutting it down.
+		// -----------------------------------------------------------------------------------------------
+		void set_running(bool _running)
+		{
+			m_isRunning = _running; 
+			m_queueConditionVar.notify_all();
+			m_parkConditionVar.notify_all();
+			m_spareConditionVar.notify_all();
+
+			if (!_running)
+			{
+				wake_blocked_workers();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Check if the scheduler is paused.
+		// -----------------------------------------------------------------------------------------------
+		bool is_paused() const { return m_isPaused; }
+
+		// -----------------------------------------------------------------------------------------------
+		// Set the paused status of the scheduler. Worker threads will not process anything until status is resumed.
+		// -----------------------------------------------------------------------------------------------
+		void set_paused(bool _paused)
+		{
+			m_isPaused = _paused;
+			m_queueConditionVar.notify_all();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Allow the current thread to sleep for specified duration in ms.
+		// -----------------------------------------------------------------------------------------------
+		void sleep(uint32_t ms)
+		{
+			thread_backend::sleep(ms);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Wait for all the worker threads to stop executing, block the main thread.
+		// -----------------------------------------------------------------------------------------------
+		void join()
+		{
+			YATM_ASSERT(m_threads != nullptr);
+			for (uint32_t i = 0; i < m_numThreads; ++i)
+			{
+				m_threads[i].join();
+			}
+
+			for (spare_worker* const spare : m_spareWorkers)
+			{
+				spare->m_thread.join();
+				delete spare;
+			}
+			m_spareWorkers.clear();
+		}
+
+	private:
+		condition_var_type		m_queueConditionVar;
+		condition_var_type		m_parkConditionVar;
+		condition_var_type		m_spareConditionVar;
+		mutex_type				m_queueMutex;
+		mutex_type				m_pendingJobsMutex;
+		size_t					m_stackSizeInBytes;
+		uint32_t				m_hwConcurency;
+		uint32_t				m_numThreads;
+		uint32_t				m_numQueuedJobs;
+		uint32_t				m_numQueuedMemoryBound;		// Memory-bound jobs among the queued jobs.
+		uint32_t				m_numRunningMemoryBound;
+		uint32_t				m_memoryBoundLimit;			// ~0u for no limit.
+		uint32_t				m_numQueuedBackground;		// Background jobs among the queued jobs.
+		uint32_t				m_numRunningBackground;
+		uint32_t				m_backgroundLimit;			// ~0u for no limit.
+		counter					m_numReadyForeground;		// Queued jobs that aren't background jobs and whose dependencies are done, read without the lock by should_preempt().
+		uint32_t				m_numBlockedWorkers;		// Workers in blocking regions, as many spares run.
+		uint32_t				m_maxSpareWorkers;
+		std::vector<spare_worker*>	m_spareWorkers;			// Spares started so far, protected by the queue mutex.
+		bool					m_isStartingSpare;			// A spare thread is being started outside of the queue lock, protected by it.
+		std::vector<resource>	m_resources;				// Protected by the queue mutex.
+		uint32_t				m_numWaitingThreads;
+		uint32_t				m_stealThreshold;
+		uint32_t				m_numActiveThreads;
+		uint32_t				m_minActiveThreads;
+		uint32_t				m_queueDelayTargetInUs;
+		uint32_t				m_parkingIntervalInUs;
+		uint64_t				m_periodStartInUs;
+		uint64_t				m_periodBusyTimeInUs;
+		uint64_t				m_periodQueueDelayInUs;
+		uint64_t				m_periodJobs;
+		bool					m_admissionControl;
+		uint32_t				m_admissionDelayTargetInUs;
+		uint32_t				m_admissionIntervalInUs;
+		uint64_t				m_admissionAboveTargetSinceInUs;
+		std::atomic<bool>		m_isShedding;				// Written under the queue mutex, read without it by is_shedding().
+		std::function<void(job* const)>	m_shedCallback;
+		bool					m_isRunning;
+		bool					m_isPaused;
+		thread_type*			m_threads;
+		worker_data*			m_workers;
+		job_queue				m_jobQueue;
+		job_queue				m_highPriorityJobQueue;
+		job_queue				m_backgroundJobQueue;
+		std::vector<job*>		m_activeBatches;
+		std::vector<job*>		m_cappedJobs;				// Ready jobs taken from the queues while they couldn't start, see take_ready_job().
+		counter					m_numReadyHighPriorityJobs;		// Queued high priority jobs whose dependencies are done.
+		std::vector<job*>		m_pendingJobsToAdd;
+		mutex_type				m_batchersMutex;			// Locked before the batchers, which are locked before the queue.
+		std::vector<submission_batcher*>	m_batchers;		// Batchers flushed by idle workers.
+		uint64_t				m_batchDeadlineInUs = c_noBatchDeadline;	// When idle workers flush the batchers, protected by the queue mutex.
+		allocator*				m_scratch;
+		instrumentation			m_instrumentation;
+		stack_pool_type			m_stackPool;
+		shared_pool_type*		m_sharedPool = nullptr;
+		const function_registry_type*	m_sharedRegistry = nullptr;
+		uint32_t				m_sharedPoolTimeoutInMs = YATM_DEFAULT_SHARED_POOL_TIMEOUT_MS;
+		bool					m_isSharedPoolWaiting = false;
+		mutex_type							m_reactorMutex;
+		int									m_reactorPollFd = -1;
+		int									m_reactorWakeFd = -1;
+		uint32_t							m_reactorTimeoutInMs;
+		uint32_t							m_reactorBusyPollIntervalInUs;
+		uint64_t							m_reactorLastPollInUs;
+		uint32_t							m_numReactorRegistrations = 0u;
+		bool								m_isReactorPolling = false;
+		std::vector<reactor_registration*>	m_reactorRegistrations;
+		std::vector<reactor_registration*>	m_retiredRegistrations;
+
+#if YATM_DEBUG
+		// -----------------------------------------------------------------------------------------------
+		// Verify the job graph.
+		// -----------------------------------------------------------------------------------------------
+		void verify_job_graph()
+		{
+
+		}
+#endif // YATM_DEBUG
+
+		// -----------------------------------------------------------------------------------------------
+		// Allocate and set up the payload ranges of a batch job from the scheduler scratch allocator.
+		// -----------------------------------------------------------------------------------------------
+		template<typename T>
+		job_batch* new_batch(void(*_function)(T*, size_t), T* const _payloads, size_t _count, size_t _grainSize)
+		{
+			YATM_ASSERT(_function != nullptr && (_payloads != nullptr || _count == 0u));
+
+			job_batch* const batch = allocate<job_batch>();
+			batch->m_invoke = [](const job_batch& _batch, size_t _begin, size_t _num)
+			{
+				reinterpret_cast<void(*)(T*, size_t)>(_batch.m_function)((T*)_batch.m_payloads + _begin, _num);
+			};
+			batch->m_function = reinterpret_cast<job_batch::FuncPtr>(_function);
+			batch->m_payloads = (void*)_payloads;
+			batch->m_count = _count;
+			batch->m_grainSize = _grainSize > 0u ? _grainSize : std::max<size_t>(1u, _count / (4u * std::max(1u, m_numThreads)));
+			batch->m_numRanges = (uint32_t)((_count + batch->m_grainSize - 1u) / batch->m_grainSize);
+			batch->m_numWorkers = 0u;
+			batch->m_isActive = false;
+
+			return batch;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Initialise a job, allocated from the scratch allocator or owned by a scheduler helper.
+		// -----------------------------------------------------------------------------------------------
+		template<typename Function>
+		void init_job(job* const _job, const Function& _function, void* const _data, counter* _counter, uint64_t _affinity)
+		{
+			_job->m_function = _function;
+			_job->m_data = _data;
+			_job->m_parent = nullptr;
+			_job->m_counter = _counter;
+			_job->m_affinity = _affinity;
+			_job->m_preferredWorker = c_invalidWorker;
+			_job->m_priority = job_priority::normal;
+			_job->m_class = job_class::compute;
+			_job->m_resource = c_noResource;
+			_job->m_resourceTokens = 0u;
+			_job->m_batch = nullptr;
+			_job->m_isPublished = false;
+
+			// Initialise the job with 1 pending job (itself).
+			// Adding dependencies increments the pending counter, resolving dependencies decrements it.
+			_job->m_pendingJobs.increment();
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Add scratch allocated jobs to the queues under a single lock and wake up as many workers as there is work for.
+		// While admission control is shedding, low priority jobs are rejected instead. _areCounted is set if the jobs' counters were
+		// already incremented.
+		// -----------------------------------------------------------------------------------------------
+		void publish_jobs(job* const* _jobs, size_t _count, bool _areCounted = false)
+		{
+			uint32_t num_active = 0u;
+			bool has_affinity = false;
+			std::vector<job*> shed_jobs;
+			bool wake_blocked = false;
+
+			{
+				scoped_lock<mutex_type> queue_lock(&m_queueMutex);
+
+				for (size_t i = 0; i < _count; ++i)
+				{
+					// Verify that the job and its data is allocated from scratch buffer.
+					YATM_ASSERT(m_scratch->is_from(_jobs[i]));
+
+					if (m_isShedding.load(std::memory_order_relaxed) && _jobs[i]->m_priority == job_priority::low)
+					{
+						m_instrumentation.on_shed();
+						shed_jobs.push_back(_jobs[i]);
+						continue;
+					}
+
+					add_job(_jobs[i], c_invalidWorker, _areCounted);
+					has_affinity |= (_jobs[i]->m_affinity != c_noAffinity);
+				}
+				_count -= shed_jobs.size();
+
+				// Busy workers might not get back to the queue for a while, so evaluate utilization here too.
+				if (is_parking_enabled())
+				{
+					update_parking(get_time_in_us());
+				}
+				num_active = m_numActiveThreads;
+
+				// Workers blocked in the reactor or on the shared pool don't see notifications; interrupt them if the waiting workers
+				// can't take all the work.
+				wake_blocked = is_worker_blocked() && _count > m_numWaitingThreads;
+			}
+
+			if (wake_blocked)
+			{
+				wake_blocked_workers();
+			}
+
+			// Shed jobs are finished without running, so that their dependencies still resolve; their counter is only decremented if it
+			// was incremented before publishing.
+			if (!shed_jobs.empty())
+			{
+				if (m_shedCallback != nullptr)
+				{
+					for (job* const j : shed_jobs)
+					{
+						m_shedCallback(j);
+					}
+				}
+
+				scoped_lock<mutex_type> queue_lock(&m_queueMutex);
+				for (job* const j : shed_jobs)
+				{
+					counter* const job_counter = j->m_counter;
+					if (finish_job(j) && _areCounted && job_counter != nullptr)
+					{
+						job_counter->decrement();
+					}
+				}
+			}
+
+			// Only wake up as many workers as there is work for. Jobs with an affinity key need their preferred worker awake,
+			// which a single notification can't target.
+			if (_count >= num_active || has_affinity)
+			{
+				m_queueConditionVar.notify_all();
+			}
+			else
+			{
+				for (size_t i = 0; i < _count; ++i)
+				{
+					m_queueConditionVar.notify_one();
+				}
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Add a single job straight to the queues and wake a worker for it, without going through the pending jobs.
+		// Used by helpers that own their jobs, rather than allocating them from the scratch allocator.
+		// -----------------------------------------------------------------------------------------------
+		void submit_job(job* const _job)
+		{
+			bool wake_blocked = false;
+
+			// Once queued, the job may run and be reused by its owner before this returns.
+			const bool has_affinity = _job->m_affinity != c_noAffinity;
+			{
+				scoped_lock<mutex_type> lock(&m_queueMutex);
+				add_job(_job);
+
+				// As in publish_jobs(), a backlog built up by helpers must be able to unpark workers while the busy ones run long jobs.
+				if (is_parking_enabled())
+				{
+					update_parking(get_time_in_us());
+				}
+				wake_blocked = is_worker_blocked() && m_numWaitingThreads == 0u;
+			}
+
+			if (wake_blocked)
+			{
+				wake_blocked_workers();
+			}
+
+			// A single notification can't target the preferred worker of a job with an affinity key.
+			if (has_affinity)
+			{
+				m_queueConditionVar.notify_all();
+			}
+			else
+			{
+				m_queueConditionVar.notify_one();
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Adds a single job item to the scheduler, optionally straight to the local queue of a worker. The job's counter is incremented
+		// unless _isCounted is set. Assumes the caller ensures thread safety.
+		// -----------------------------------------------------------------------------------------------
+		void add_job(job* const _job, uint32_t _worker = c_invalidWorker, bool _isCounted = false)
+		{
+			YATM_ASSERT(_job != nullptr);
+
+			if (_job->m_counter != nullptr && !_isCounted)
+			{
+				_job->m_counter->increment();
+			}
+
+			if (is_queue_timing_enabled())
+			{
+				_job->m_queueTime = get_time_in_us();
+			}
+
+			// Jobs with an affinity key are queued on their preferred worker, picked now so that it doesn't change while they wait.
+			if (_job->m_priority == job_priority::background)
+			{
+				m_numQueuedBackground++;
+			}
+			else if (_job->m_priority != job_priority::high && _worker < m_numThreads)
+			{
+				_job->m_preferredWorker = _worker;
+			}
+			else if (_job->m_priority != job_priority::high && _job->m_affinity != c_noAffinity && m_numActiveThreads > 0u)
+			{
+				_job->m_preferredWorker = hash_affinity(_job->m_affinity);
+			}
+			m_numQueuedJobs++;
+
+			if (_job->m_class == job_class::memory_bound)
+			{
+				m_numQueuedMemoryBound++;
+			}
+
+			if (_job->m_resource != c_noResource)
+			{
+				resource& r = m_resources[_job->m_resource];
+				r.m_numQueued++;
+				r.m_numQueuedByTokens[_job->m_resourceTokens]++;
+			}
+
+			// Jobs whose dependencies finish later are queued by finish_job().
+			_job->m_isPublished = true;
+			if (_job->m_pendingJobs.is_equal(1u))
+			{
+				on_job_ready(_job);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Mark this job as finished by decrementing the pendingJobs counter and inform its parents recursively. A parent made ready is
+		// queued, or returned through _readyParent if specified. Returns true if the job has finished, false if it is still held (see
+		// hold_current_job()). Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		bool finish_job(job* const _job, bool _isDependency = false, job** const _readyParent = nullptr)
+		{
+			if (_job != nullptr)
+			{
+				// Read the parent before decrementing, a finished job can be recycled straight away.
+				job* const parent = _job->m_parent;
+				const uint32_t p = _job->m_pendingJobs.decrement();
+				// If this job has finished, inform its parent.
+				if (p == 0)
+				{
+					finish_job(parent, true, _readyParent);
+					return true;
+				}
+
+				// The last dependency of a published job finished, or the job was added again while it ran; jobs that aren't published yet
+				// are queued when they are.
+				if (p == 1 && _job->m_isPublished)
+				{
+					if (_isDependency && _readyParent != nullptr)
+					{
+						*_readyParent = _job;
+					}
+					else
+					{
+						on_job_ready(_job);
+					}
+				}
+			}
+			return false;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Account for a published job whose dependencies are done, and queue it. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void on_job_ready(job* const _job)
+		{
+			if (_job->m_priority != job_priority::background)
+			{
+				m_numReadyForeground.increment();
+			}
+
+			if (_job->m_priority == job_priority::high)
+			{
+				m_numReadyHighPriorityJobs.increment();
+			}
+
+			queue_job(_job);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Push a ready job to its queue: high priority and background jobs have their own, jobs with a preferred worker go to its local
+		// queue, the rest to the global queue. Assumes the queue mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		void queue_job(job* const _job)
+		{
+			if (_job->m_priority == job_priority::high)
+			{
+				m_highPriorityJobQueue.push(_job);
+			}
+			else if (_job->m_priority == job_priority::background)
+			{
+				m_backgroundJobQueue.push(_job);
+			}
+			else if (_job->m_preferredWorker < m_numThreads)
+			{
+				m_workers[_job->m_preferredWorker].m_localQueue.push(_job);
+			}
+			else
+			{
+				m_jobQueue.push(_job);
+			}
+		}
+	};
+
+#if YATM_NIX
+	// -----------------------------------------------------------------------------------------------
+	// Offloads jobs to peer processes running a remote_job_server, over TCP. A remote job is a registered function id and a payload,
+	// which the function reads and overwrites with its result; the payload is sent to a peer and the response copied back over it.
+	// The job itself is local: it's created from the scheduler scratch allocator, kicked, depended on and waited for like any other
+	// job, and finishes once its result is back, without occupying a worker in the meantime.
+	//
+	// Each peer has a window of requests in flight. A job that finds every window full runs locally instead, as does a job whose peer
+	// doesn't answer within the timeout (its late response is dropped) or whose connection is lost. The offloader must outlive its jobs.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Policies>
+	class basic_scheduler<Policies>::remote_offloader
+	{
+	public:
+		// -----------------------------------------------------------------------------------------------
+		remote_offloader(basic_scheduler& _scheduler, const function_registry& _registry, const remote_offload_desc& _desc = remote_offload_desc())
+			: m_scheduler(&_scheduler), m_registry(&_registry), m_desc(_desc), m_nextRequestId(0u), m_isRunning(true)
+		{
+			m_desc.m_windowSize = std::max(1u, m_desc.m_windowSize);
+			m_desc.m_timeoutInMs = std::max(1u, m_desc.m_timeoutInMs);
+
+			auto func = [](void* _data) -> uint32_t
+			{
+				((remote_offloader*)_data)->io_entry_point();
+				return 0u;
+			};
+			m_thread.create(0u, YATM_DEFAULT_STACK_SIZE, func, this);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		~remote_offloader()
+		{
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				m_isRunning = false;
+			}
+			m_thread.join();
+
+			// Nothing answers the requests still in flight anymore.
+			for (peer* const p : m_peers)
+			{
+				for (const in_flight_request& r : p->m_inFlight)
+				{
+					if (r.m_request != nullptr)
+					{
+						run_local(r.m_request);
+						m_scheduler->release_job(r.m_request->m_job);
+					}
+				}
+
+				if (p->m_fd >= 0)
+				{
+					::close(p->m_fd);
+				}
+				delete p;
+			}
+
+			for (fallback* const f : m_fallbacks)
+			{
+				while (!f->m_job.m_pendingJobs.is_done())
+				{
+					thread_backend::yield();
+				}
+				delete f;
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		remote_offloader(const remote_offloader&) = delete;
+		remote_offloader& operator=(const remote_offloader&) = delete;
+
+		// -----------------------------------------------------------------------------------------------
+		// Connect to a peer's remote_job_server. Returns false if the connection fails.
+		// -----------------------------------------------------------------------------------------------
+		bool add_peer(const char* _host, uint16_t _port)
+		{
+			const int fd = socket_open(_host, _port, false);
+			if (fd < 0)
+			{
+				return false;
+			}
+
+			peer* const p = new peer();
+			p->m_fd = fd;
+			p->m_isConnected = true;
+
+			scoped_lock<mutex> lock(&m_mutex);
+			m_peers.push_back(p);
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Create a remote job from the scheduler scratch allocator, running the function registered as _functionId over the payload.
+		// The payload must stay valid until the job has finished; the function's result is written back to it. Kick the scheduler
+		// to start the job.
+		// -----------------------------------------------------------------------------------------------
+		job* const create_job(uint32_t _functionId, void* const _payload, size_t _size, counter* _counter)
+		{
+			YATM_ASSERT(m_registry->get(_functionId) != nullptr && _size <= YATM_DEFAULT_OFFLOAD_MAX_PAYLOAD_SIZE);
+
+			remote_request* const r = m_scheduler->template allocate<remote_request>();
+			r->m_payload = _payload;
+			r->m_size = _size;
+			r->m_functionId = _functionId;
+			r->m_job = nullptr;
+			r->m_sentTimeInUs = 0u;
+			r->m_isSending = false;
+
+			return m_scheduler->create_job([this](void* const _data) { offload((remote_request*)_data); }, r, _counter);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the number of peers still connected.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t get_num_peers()
+		{
+			scoped_lock<mutex> lock(&m_mutex);
+			return (uint32_t)std::count_if(m_peers.begin(), m_peers.end(), [](const peer* const _peer) { return _peer->m_isConnected; });
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Return where jobs ran and how many peers were lost.
+		// -----------------------------------------------------------------------------------------------
+		remote_offload_stats get_stats()
+		{
+			scoped_lock<mutex> lock(&m_mutex);
+			return m_stats;
+		}
+
+	private:
+		// A remote job's data, allocated from the scheduler scratch allocator.
+		struct remote_request
+		{
+			void*		m_payload;
+			size_t		m_size;
+			uint32_t	m_functionId;
+			job*		m_job;				// Held until the result is back.
+			uint64_t	m_sentTimeInUs;
+			bool		m_isSending;		// Its payload is being sent, set by the worker offloading it.
+		};
+
+		struct in_flight_request
+		{
+			uint64_t		m_id;
+			remote_request*	m_request;		// nullptr once the request ran locally; it holds on to the window until its response arrives.
+		};
+
+		struct peer
+		{
+			int								m_fd;
+			bool							m_isConnected;
+			mutex							m_sendMutex;
+			std::vector<in_flight_request>	m_inFlight;
+			std::vector<uint8_t>			m_received;		// Bytes of responses not received in full yet, only used by the IO thread.
+		};
+
+		// A job running a request locally, owned by the offloader so that it outlives the request.
+		struct fallback
+		{
+			job				m_job;
+			remote_request*	m_request;
+		};
+
+		basic_scheduler*			m_scheduler;
+		const function_registry*	m_registry;
+		remote_offload_desc			m_desc;
+		mutex						m_mutex;
+		std::vector<peer*>			m_peers;
+		std::vector<fallback*>		m_fallbacks;
+		remote_offload_stats		m_stats;
+		uint64_t					m_nextRequestId;
+		bool						m_isRunning;
+		thread						m_thread;
+
+		// -----------------------------------------------------------------------------------------------
+		// The function of every remote job, running on a worker: send the request to the least loaded peer with room in its window,
+		// or run it locally.
+		// -----------------------------------------------------------------------------------------------
+		void offload(remote_request* const _request)
+		{
+			peer* p = nullptr;
+			uint64_t id = 0u;
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				for (peer* const candidate : m_peers)
+				{
+					if (candidate->m_isConnected && candidate->m_inFlight.size() < m_desc.m_windowSize && (p == nullptr || candidate->m_inFlight.size() < p->m_inFlight.size()))
+					{
+						p = candidate;
+					}
+				}
+
+				if (p == nullptr)
+				{
+					m_stats.m_localJobs++;
+				}
+				else
+				{
+					id = m_nextRequestId++;
+					_request->m_job = m_scheduler->hold_current_job();
+					_request->m_sentTimeInUs = get_time_in_us();
+					_request->m_isSending = true;
+					p->m_inFlight.push_back({ id, _request });
+				}
+			}
+
+			if (p == nullptr)
+			{
+				run_local(_request);
+				return;
+			}
+
+			const remote_message_header header = { id, _request->m_functionId, (uint32_t)_request->m_size };
+			bool sent;
+			{
+				scoped_lock<mutex> lock(&p->m_sendMutex);
+				sent = p->m_fd >= 0 && socket_send_all(p->m_fd, &header, sizeof(header)) && socket_send_all(p->m_fd, _request->m_payload, _request->m_size);
+			}
+
+			// If the peer was lost meanwhile, its other requests have been taken care of already, but not this one.
+			bool run_here = false;
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				_request->m_isSending = false;
+				if (!sent)
+				{
+					fail_peer(*p);
+				}
+
+				if (!p->m_isConnected)
+				{
+					run_here = take_request(*p, id) != nullptr;
+				}
+			}
+
+			if (run_here)
+			{
+				run_local(_request);
+				m_scheduler->release_job(_request->m_job);
+			}
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		void run_local(remote_request* const _request)
+		{
+			m_registry->get(_request->m_functionId)(_request->m_payload, _request->m_size);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove a request from a peer's window, returning it. Assumes m_mutex is held.
+		// -----------------------------------------------------------------------------------------------
+		remote_request* take_request(peer& _peer, uint64_t _id)
+		{
+			for (size_t i = 0; i < _peer.m_inFlight.size(); ++i)
+			{
+				if (_peer.m_inFlight[i].m_id == _id)
+				{
+					remote_request* const r = _peer.m_inFlight[i].m_request;
+					_peer.m_inFlight.erase(_peer.m_inFlight.begin() + i);
+					return r;
+				}
+			}
+			return nullptr;
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Adds a job dependency on the specified job.
+		// Queue a job running a request locally, then releasing its remote job. Assumes m_mutex is held.
 		// -----------------------------------------------------------------------------------------------
-		void depend(job* const _target, job* const _dependency)
+		void run_fallback(remote_request* const _request)
 		{
-			YATM_ASSERT(_dependency->m_parent == nullptr);
+			auto it = std::find_if(m_fallbacks.begin(), m_fallbacks.end(), [](fallback* const _fallback) { return _fallback->m_job.m_pendingJobs.is_done(); });
+			fallback* f;
+			if (it != m_fallbacks.end())
+			{
+				f = *it;
+			}
+			else
+			{
+				f = new fallback();
+				m_fallbacks.push_back(f);
+			}
 
-			_dependency->m_parent = _target;
-			_target->m_pendingJobs.increment();
+			f->m_request = _request;
+			m_scheduler->init_job(&f->m_job, [this](void* const _data)
+			{
+				remote_request* const r = ((fallback*)_data)->m_request;
+				run_local(r);
+				m_scheduler->release_job(r->m_job);
+			}, f, nullptr, c_noAffinity);
+			m_scheduler->submit_job(&f->m_job);
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Creates a parallel for loop for the specified collection, launching _function per iteration.
-		// Blocks until all are complete.
+		// Stop using a peer and run its requests locally, except those still being sent, which their worker takes care of.
+		// Assumes m_mutex is held.
 		// -----------------------------------------------------------------------------------------------
-		template<typename Iterator, typename Function>
-		void parallel_for(const Iterator& _begin, const Iterator& _end, const Function& _function)
+		void fail_peer(peer& _peer)
 		{
-			const size_t n = std::distance(_begin, _end);
-			if (n > 0)
+			if (!_peer.m_isConnected)
 			{
-				// When there is only 1 job, don't pass it through the scheduler.
-				if (n == 1)
+				return;
+			}
+
+			_peer.m_isConnected = false;
+			m_stats.m_peerFailures++;
+
+			for (size_t i = 0; i < _peer.m_inFlight.size(); )
+			{
+				remote_request* const r = _peer.m_inFlight[i].m_request;
+				if (r != nullptr && r->m_isSending)
 				{
-					_function(&(*(_begin)));
+					++i;
+					continue;
 				}
-				else
-				{
-					counter jobs_done;
-					for (uint32_t i = 0; i < n; ++i)
-					{
-						job* j = create_job(_function, &(*(_begin + i)), &jobs_done);
-					}
 
-					kick();
-					wait(&jobs_done);
+				if (r != nullptr)
+				{
+					run_fallback(r);
 				}
+				_peer.m_inFlight.erase(_peer.m_inFlight.begin() + i);
 			}
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Signal the worker threads that work has been added.
+		// Read what a peer has sent so far without blocking, and complete the jobs whose response arrived in full. The rest of a
+		// partial response is read once it arrives, so that a slow peer doesn't hold up the responses and timeouts of the others.
 		// -----------------------------------------------------------------------------------------------
-		void kick()
+		void receive(peer& _peer)
 		{
-			// Add the pending jobs to the global job queue and notify the worker threads that work has been added.
+			// The socket stays blocking for the workers sending requests, only this read doesn't wait.
+			const size_t previous_size = _peer.m_received.size();
+			_peer.m_received.resize(previous_size + YATM_DEFAULT_OFFLOAD_RECEIVE_SIZE);
+			const ssize_t n = recv(_peer.m_fd, _peer.m_received.data() + previous_size, YATM_DEFAULT_OFFLOAD_RECEIVE_SIZE, MSG_DONTWAIT);
+			_peer.m_received.resize(previous_size + (n > 0 ? (size_t)n : 0u));
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
 			{
-				scoped_lock<mutex> lock(&m_pendingJobsMutex);
-
-#if YATM_DEBUG
-				verify_job_graph();
-#endif // YATM_DEBUG
+				return;
+			}
 
-				for (auto& job : m_pendingJobsToAdd)
+			bool ok = n > 0;
+			size_t offset = 0u;
+			while (ok && _peer.m_received.size() - offset >= sizeof(remote_message_header))
+			{
+				remote_message_header header;
+				memcpy(&header, _peer.m_received.data() + offset, sizeof(header));
+				ok = header.m_payloadSize <= YATM_DEFAULT_OFFLOAD_MAX_PAYLOAD_SIZE;
+				if (!ok || _peer.m_received.size() - offset - sizeof(header) < header.m_payloadSize)
 				{
-					// Verify that the job and its data is allocated from scratch buffer.
-					YATM_ASSERT(m_scratch->is_from(job));
-
-					add_job(job);
+					break;
 				}
-				m_pendingJobsToAdd.clear();
+
+				complete(_peer, header, _peer.m_received.data() + offset + sizeof(header));
+				offset += sizeof(header) + header.m_payloadSize;
 			}
+			_peer.m_received.erase(_peer.m_received.begin(), _peer.m_received.begin() + offset);
 
-			m_queueConditionVar.notify_all();
+			if (!ok)
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+				fail_peer(_peer);
+			}
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Wait for a single job to complete. In the meantime, try to process one pending job.
+		// Complete the job of a response received from a peer.
 		// -----------------------------------------------------------------------------------------------
-		void wait(job* const _job)
+		void complete(peer& _peer, const remote_message_header& _header, const uint8_t* _payload)
 		{
-			YATM_ASSERT(_job != nullptr);
-			while (!_job->m_pendingJobs.is_done())
-			{				
-				// Process jobs while waiting
-				scoped_lock<mutex> lock(&m_queueMutex);
-				worker_internal(lock);
+			remote_request* r = nullptr;
+			{
+				scoped_lock<mutex> lock(&m_mutex);
+
+				// Requests that timed out ran locally already, the response is dropped.
+				r = take_request(_peer, _header.m_requestId);
+				if (r == nullptr)
+				{
+					return;
+				}
+
+				if (_header.m_payloadSize != r->m_size)
+				{
+					run_fallback(r);
+					return;
+				}
+				m_stats.m_remoteJobs++;
 			}
+
+			memcpy(r->m_payload, _payload, r->m_size);
+			m_scheduler->release_job(r->m_job);
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Wait for a counter to reach 0. In the meantime, try to process one pending job.
+		// The thread receiving responses and timing out requests.
 		// -----------------------------------------------------------------------------------------------
-		void wait(counter* const _counter)
+		void io_entry_point()
 		{
-			YATM_ASSERT(_counter != nullptr);
-			while (!_counter->is_done())
+			const uint64_t timeout_in_us = (uint64_t)m_desc.m_timeoutInMs * 1000u;
+			const int poll_interval_in_ms = (int)std::max(1u, std::min(10u, m_desc.m_timeoutInMs / 4u));
+
+			std::vector<pollfd> fds;
+			std::vector<peer*> polled_peers;
+
+			for (;;)
 			{
-				// Process jobs while waiting
-				scoped_lock<mutex> lock(&m_queueMutex);
-				worker_internal(lock);
+				fds.clear();
+				polled_peers.clear();
+				{
+					scoped_lock<mutex> lock(&m_mutex);
+					if (!m_isRunning)
+					{
+						break;
+					}
+
+					const uint64_t now = get_time_in_us();
+					for (peer* const p : m_peers)
+					{
+						if (!p->m_isConnected)
+						{
+							// Lost peers are closed here, so that the fd can't be reused while it's being polled.
+							if (p->m_fd >= 0)
+							{
+								scoped_lock<mutex> send_lock(&p->m_sendMutex);
+								::close(p->m_fd);
+								p->m_fd = -1;
+							}
+							continue;
+						}
+
+						for (in_flight_request& r : p->m_inFlight)
+						{
+							if (r.m_request != nullptr && !r.m_request->m_isSending && now - r.m_request->m_sentTimeInUs >= timeout_in_us)
+							{
+								m_stats.m_timeouts++;
+								run_fallback(r.m_request);
+								r.m_request = nullptr;
+							}
+						}
+
+						fds.push_back({ p->m_fd, POLLIN, 0 });
+						polled_peers.push_back(p);
+					}
+				}
+
+				if (poll(fds.data(), (nfds_t)fds.size(), poll_interval_in_ms) <= 0)
+				{
+					continue;
+				}
+
+				for (size_t i = 0; i < fds.size(); ++i)
+				{
+					if (fds[i].revents != 0)
+					{
+						receive(*polled_peers[i]);
+					}
+				}
 			}
 		}
+	};
 
+	// -----------------------------------------------------------------------------------------------
+	// Serves the requests of remote_offloaders over TCP, running each as a job of this scheduler and sending its payload back once
+	// the function has run. Requires worker threads; connections are served by the thread calling run(), until stop() is called.
+	// -----------------------------------------------------------------------------------------------
+	template<typename Policies>
+	class basic_scheduler<Policies>::remote_job_server
+	{
+	public:
 		// -----------------------------------------------------------------------------------------------
-		// Yield the current thread and allow others to execute.
-		// -----------------------------------------------------------------------------------------------
-		void yield()
+		remote_job_server(basic_scheduler& _scheduler, const function_registry& _registry)
+			: m_scheduler(&_scheduler), m_registry(&_registry), m_listenFd(-1), m_port(0u), m_numServed(0u), m_isRunning(false)
 		{
-#if YATM_STD_THREAD
-			std::this_thread::yield();
-#elif YATM_WIN64
-			SwitchToThread();
-#endif // YATM_STD_THREAD
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Return the maximum number of worker threads.
-		// -----------------------------------------------------------------------------------------------
-		uint32_t get_max_threads() const { return m_hwConcurency; }
+		~remote_job_server()
+		{
+			stop();
 
-		// -----------------------------------------------------------------------------------------------
-		// Check if the scheduler is running worker functions.
-		// -----------------------------------------------------------------------------------------------
-		bool is_running() const { return m_isRunning; }
+			for (request* const r : m_requests)
+			{
+				while (!r->m_job.m_pendingJobs.is_done())
+				{
+					thread_backend::yield();
+				}
+				delete r;
+			}
 
-		// -----------------------------------------------------------------------------------------------
-		// Stop the scheduler from processing, effectively shutting it down.
-		// -----------------------------------------------------------------------------------------------
-		void set_running(bool _running)
-		{
-			m_isRunning = _running; 
-			m_queueConditionVar.notify_all();
+			for (connection* const c : m_connections)
+			{
+				::close(c->m_fd);
+				delete c;
+			}
+
+			if (m_listenFd >= 0)
+			{
+				::close(m_listenFd);
+			}
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Check if the scheduler is paused.
-		// -----------------------------------------------------------------------------------------------
-		bool is_paused() const { return m_isPaused; }
+		remote_job_server(const remote_job_server&) = delete;
+		remote_job_server& operator=(const remote_job_server&) = delete;
 
 		// -----------------------------------------------------------------------------------------------
-		// Set the paused status of the scheduler. Worker threads will not process anything until status is resumed.
+		// Listen for offloaders on the specified address and port; port 0 picks a free one (see get_port()).
 		// -----------------------------------------------------------------------------------------------
-		void set_paused(bool _paused)
+		bool listen(uint16_t _port, const char* _address = "127.0.0.1")
 		{
-			m_isPaused = _paused;
-			m_queueConditionVar.notify_all();
+			YATM_ASSERT(m_listenFd < 0);
+
+			m_listenFd = socket_open(_address, _port, true);
+			if (m_listenFd < 0)
+			{
+				return false;
+			}
+
+			sockaddr_storage address;
+			socklen_t length = sizeof(address);
+			getsockname(m_listenFd, (sockaddr*)&address, &length);
+			m_port = ntohs(address.ss_family == AF_INET6 ? ((sockaddr_in6*)&address)->sin6_port : ((sockaddr_in*)&address)->sin_port);
+
+			scoped_lock<mutex> lock(&m_mutex);
+			m_isRunning = true;
+			return true;
 		}
 
 		// -----------------------------------------------------------------------------------------------
-		// Allow the current thread to sleep for specified duration in ms.
+		// Return the port the server listens on.
 		// -----------------------------------------------------------------------------------------------
-		void sleep(uint32_t ms)
-		{
-#if YATM_STD_THREAD			
-			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
-#elif YATM_WIN64
-			Sleep(ms);
-#endif // YATM_STD_THREAD
-		}
+		uint16_t get_port() const { return m_port; }
 
 		// -----------------------------------------------------------------------------------------------
-		// Wait for all the worker threads to stop executing, block the main thread.
+		// Accept connections and queue their requests as jobs until stop() is called.
 		// -----------------------------------------------------------------------------------------------
-		void join()
+		void run()
 		{
-			YATM_ASSERT(m_threads != nullptr);
-			for (uint32_t i = 0; i < m_numThreads; ++i)
+			YATM_ASSERT(m_listenFd >= 0 && m_scheduler->m_numThreads > 0u);
+
+			std::vector<pollfd> fds;
+			while (is_running())
 			{
-				m_threads[i].join();
+				recycle();
+
+				fds.clear();
+				fds.push_back({ m_listenFd, POLLIN, 0 });
+				for (connection* const c : m_connections)
+				{
+					fds.push_back({ c->m_isOpen ? c->m_fd : -1, POLLIN, 0 });
+				}
+
+				if (poll(fds.data(), (nfds_t)fds.size(), 10) <= 0)
+				{
+					continue;
+				}
+
+				// Accepting changes m_connections, serve the connections polled first.
+				for (size_t i = 1; i < fds.size(); ++i)
+				{
+					if (fds[i].revents != 0)
+					{
+						serve(*m_connections[i - 1u]);
+					}
+				}
+
+				if (fds[0].revents != 0)
+				{
+					const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+					if (fd >= 0)
+					{
+						const int one = 1;
+						setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+						connection* const c = new connection();
+						c->m_fd = fd;
+						c->m_numRequests = 0u;
+						c->m_isOpen = true;
+						m_connections.push_back(c);
+					}
+				}
 			}
 		}
 
-	private:
-		condition_var			m_queueConditionVar;
-		mutex					m_queueMutex;
-		mutex					m_pendingJobsMutex;
-		size_t					m_stackSizeInBytes;
-		uint32_t				m_hwConcurency;
-		uint32_t				m_numThreads;
-		bool					m_isRunning;
-		bool					m_isPaused;
-		thread*					m_threads;
-		std::vector<job*>		m_jobQueue;
-		std::vector<job*>		m_pendingJobsToAdd;
-
-#if YATM_DEBUG
 		// -----------------------------------------------------------------------------------------------
-		// Verify the job graph.
+		// Make run() return. Can be called from any thread.
 		// -----------------------------------------------------------------------------------------------
-		void verify_job_graph()
+		void stop()
 		{
-
+			scoped_lock<mutex> lock(&m_mutex);
+			m_isRunning = false;
 		}
-#endif // YATM_DEBUG
 
 		// -----------------------------------------------------------------------------------------------
-		// Adds a single job item to the scheduler. Assumes the caller ensures thread safety.
+		// Return the number of requests received.
 		// -----------------------------------------------------------------------------------------------
-		void add_job(job* const _job)
+		uint64_t get_num_served()
 		{
-			YATM_ASSERT(_job != nullptr);
+			scoped_lock<mutex> lock(&m_mutex);
+			return m_numServed;
+		}
 
-			if (_job->m_counter != nullptr)
-			{
-				_job->m_counter->increment();
-			}
+	private:
+		struct connection
+		{
+			int			m_fd;
+			mutex		m_sendMutex;
+			uint32_t	m_numRequests;		// Requests whose job hasn't finished; the fd is closed once there are none.
+			bool		m_isOpen;
+		};
 
-			m_jobQueue.push_back(_job);
-		}
+		struct request
+		{
+			job						m_job;
+			connection*				m_connection;
+			remote_message_header	m_header;
+			std::vector<uint8_t>	m_payload;
+		};
+
+		basic_scheduler*			m_scheduler;
+		const function_registry*	m_registry;
+		int							m_listenFd;
+		uint16_t					m_port;
+		std::vector<connection*>	m_connections;
+		std::vector<request*>		m_requests;
+		mutex						m_mutex;
+		uint64_t					m_numServed;
+		bool						m_isRunning;
 
 		// -----------------------------------------------------------------------------------------------
-		// Mark this job as finished by decrementing the pendingJobs counter and inform its parents recursively.
-		// -----------------------------------------------------------------------------------------------
-		void finish_job(job* const _job)
+		bool is_running()
 		{
-			if (_job != nullptr)
-			{
-				const uint32_t p = _job->m_pendingJobs.decrement();
-				// If this job has finished, inform its parent.
-				if (p == 0)
-				{
-					finish_job(_job->m_parent);
-				}
-			}
+			scoped_lock<mutex> lock(&m_mutex);
+			return m_isRunning;
 		}
-		
+
 		// -----------------------------------------------------------------------------------------------
-		// A scratch allocator to handle data and job allocations.
+		// Receive a request and queue it as a job. A connection sending a malformed request is closed.
 		// -----------------------------------------------------------------------------------------------
-		class scratch
+		void serve(connection& _connection)
 		{
-		public:
-			// -----------------------------------------------------------------------------------------------
-			scratch(size_t _sizeInBytes, size_t _alignment)
-				: m_sizeInBytes(_sizeInBytes), m_alignment(_alignment), m_begin(nullptr), m_end(nullptr), m_current(nullptr)
-
-			{
-				YATM_ASSERT(is_pow2(m_alignment));
-
-				m_sizeInBytes = m_sizeInBytes;
-
-				m_begin = (uint8_t*)aligned_alloc(m_sizeInBytes, m_alignment);
-				YATM_ASSERT(m_begin != nullptr);
-
-				m_end = m_begin + m_sizeInBytes;
-				m_current = m_begin;
-			}
-
-			scratch(const scratch&) = delete;
-			scratch& operator=(const scratch&) = delete;
-
-			// -----------------------------------------------------------------------------------------------
-			~scratch()
+			request* r = nullptr;
+			for (request* const candidate : m_requests)
 			{
-				if (m_begin != nullptr)
+				if (candidate->m_connection == nullptr)
 				{
-					aligned_free(m_begin);
+					r = candidate;
+					break;
 				}
 			}
-
-			// -----------------------------------------------------------------------------------------------
-			// Reset the scratch current pointer.
-			// -----------------------------------------------------------------------------------------------
-			void reset()
-			{
-				m_current = m_begin;
-			}
-
-			// -----------------------------------------------------------------------------------------------
-			// Return the current (aligned) address of the scratch allocator and increment the pointer.
-			// -----------------------------------------------------------------------------------------------
-			uint8_t* alloc(size_t _size, size_t _align)
+			if (r == nullptr)
 			{
-				YATM_ASSERT(is_pow2(_align));
-
-				scoped_lock<mutex> lock(&m_mutex);
-				m_current = align_ptr(m_current, _align);
-
-				YATM_ASSERT(m_current + _size < m_end);
-				uint8_t* mem = m_current;
-				m_current += _size;
-
-#if YATM_DEBUG
-				memset(mem, 0xbabababa, _size);
-#endif // YATM_DEBUG
-
-				return mem;
+				r = new request();
+				m_requests.push_back(r);
 			}
 
-			// -----------------------------------------------------------------------------------------------
-			// Checks if the input pointer is within the scratch allocator's memory boundaries.
-			// -----------------------------------------------------------------------------------------------
-			bool is_from(void* _ptr)
+			bool ok = socket_recv_all(_connection.m_fd, &r->m_header, sizeof(r->m_header)) && m_registry->get(r->m_header.m_functionId) != nullptr &&
+				r->m_header.m_payloadSize <= YATM_DEFAULT_OFFLOAD_MAX_PAYLOAD_SIZE;
+			if (ok)
 			{
-				const uint8_t* ptr = reinterpret_cast<const uint8_t*>(_ptr);
-				return (ptr >= m_begin && ptr < m_end);
+				r->m_payload.resize(r->m_header.m_payloadSize);
+				ok = socket_recv_all(_connection.m_fd, r->m_payload.data(), r->m_payload.size());
 			}
 
-		private:
-			mutex		m_mutex;
-			uint8_t*	m_begin;
-			uint8_t*	m_end;
-			uint8_t*	m_current;
-			size_t		m_sizeInBytes;
-			size_t		m_alignment;
-
-			// -----------------------------------------------------------------------------------------------
-			// Checks if the input is a power of two.
-			// -----------------------------------------------------------------------------------------------
-			bool is_pow2(size_t _n)
+			if (!ok)
 			{
-				return (_n & (_n - 1)) == 0;
+				_connection.m_isOpen = false;
+				return;
 			}
 
-		public:
-			// -----------------------------------------------------------------------------------------------
-			// A portable aligned allocation mechanism.
-			//
-			// Thanks to: https://gist.github.com/dblalock/255e76195676daa5cbc57b9b36d1c99a
-			// -----------------------------------------------------------------------------------------------
+			r->m_connection = &_connection;
+			_connection.m_numRequests++;
 
-			// -----------------------------------------------------------------------------------------------
-			void* aligned_alloc(size_t _size, size_t _alignment)
+			m_scheduler->init_job(&r->m_job, [this](void* const _data)
 			{
-				YATM_ASSERT(_alignment < UINT8_MAX);
+				request& r = *(request*)_data;
+				m_registry->get(r.m_header.m_functionId)(r.m_payload.data(), r.m_payload.size());
 
-				// over-allocate using malloc and adjust pointer by the offset needed to align the memory to specified alignment
-				const size_t request_size = _size + _alignment;
-				uint8_t* buf = (uint8_t*)malloc(request_size);
+				// A lost connection is noticed by run(), when reading from it.
+				scoped_lock<mutex> lock(&r.m_connection->m_sendMutex);
+				socket_send_all(r.m_connection->m_fd, &r.m_header, sizeof(r.m_header)) && socket_send_all(r.m_connection->m_fd, r.m_payload.data(), r.m_payload.size());
+			}, r, nullptr, c_noAffinity);
+			m_scheduler->submit_job(&r->m_job);
 
-				// figure out how much we should offset our allocation by
-				const size_t remainder = ((size_t)buf) % _alignment;
-				const size_t offset = _alignment - remainder;
-				uint8_t* ret = buf + (uint8_t)offset;
-				
-				// store how many extra bytes we allocated in the byte just before the pointer we return
-				*(uint8_t*)(ret - 1) = (uint8_t)offset;
+			scoped_lock<mutex> lock(&m_mutex);
+			m_numServed++;
+		}
 
-				return ret;
+		// -----------------------------------------------------------------------------------------------
+		// Reuse the requests whose job has finished, and close the connections that were lost once none of their jobs is running.
+		// -----------------------------------------------------------------------------------------------
+		void recycle()
+		{
+			for (request* const r : m_requests)
+			{
+				if (r->m_connection != nullptr && r->m_job.m_pendingJobs.is_done())
+				{
+					r->m_connection->m_numRequests--;
+					r->m_connection = nullptr;
+				}
 			}
 
-			// -----------------------------------------------------------------------------------------------
-			void aligned_free(const void* const aligned_ptr)
+			for (size_t i = 0; i < m_connections.size(); )
 			{
-				// find the base allocation by extracting the stored aligned offset and free it
-				uint32_t offset = *(((uint8_t*)aligned_ptr) - 1);
-				free(((uint8_t*)aligned_ptr) - offset);
+				connection* const c = m_connections[i];
+				if (!c->m_isOpen && c->m_numRequests == 0u)
+				{
+					::close(c->m_fd);
+					delete c;
+					m_connections.erase(m_connections.begin() + i);
+				}
+				else
+				{
+					++i;
+				}
 			}
-		} *m_scratch;
+		}
 	};
+#endif // YATM_NIX
+
+	// -----------------------------------------------------------------------------------------------
+	// The default scheduler.
+	// -----------------------------------------------------------------------------------------------
+	using scheduler = basic_scheduler<default_policies>;
 }
\ No newline at end of file
@@ -0,0 +1,458 @@
+/*
+** MIT License
+** 
+** Copyright(c) 2019, Pantelis Lekakis
+** 
+** Permission is hereby granted, free of charge, to any person obtaining a copy
+** of this software and associated documentation files(the "Software"), to deal
+** in the Software without restriction, including without limitation the rights
+** to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+** copies of the Software, and to permit persons to whom the Software is
+** furnished to do so, subject to the following conditions :
+** 
+** The above copyright notice and this permission notice shall be included in all
+** copies or substantial portions of the Software.
+** 
+** THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+** IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+** FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+** AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+** LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+** OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+** SOFTWARE.
+*/
+
+#pragma once
+
+#include "yatm.hpp"
+
+namespace yatm
+{
+	// -----------------------------------------------------------------------------------------------
+	// Scheduling policies modelled by the trace simulator.
+	// -----------------------------------------------------------------------------------------------
+	enum class sim_policy : uint32_t
+	{
+		fifo = 0,			// A global queue, picking the first ready job in submission order.
+		work_stealing,		// Per-core queues: jobs made ready by a core run there most recent first, idle cores steal the oldest job of the longest queue.
+		priority,			// A global queue, picking the ready job with the highest priority.
+		critical_path		// A global queue, picking the ready job with the longest path of work left after it.
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A description of a simulation run.
+	// -----------------------------------------------------------------------------------------------
+	struct sim_desc
+	{
+		uint32_t	m_numCores = 4u;					// Virtual cores running jobs.
+		sim_policy	m_policy = sim_policy::fifo;
+		uint64_t	m_dispatchOverheadInUs = 0u;		// Added to every job, e.g. queue locking and wake-ups.
+		uint64_t	m_stealOverheadInUs = 0u;			// Added to every stolen job (sim_policy::work_stealing only).
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// The predicted outcome of a simulation run.
+	// -----------------------------------------------------------------------------------------------
+	struct sim_result
+	{
+		uint64_t	m_makespanInUs = 0u;				// Time from the start of the trace until its last job finished.
+		uint64_t	m_workInUs = 0u;					// Sum of the job durations.
+		uint64_t	m_busyTimeInUs = 0u;				// Time the cores spent on jobs, including overheads.
+		uint64_t	m_criticalPathInUs = 0u;			// Longest chain of dependent jobs; no core count gets the makespan under it.
+		uint64_t	m_steals = 0u;
+		uint32_t	m_numCores = 0u;
+
+		// -----------------------------------------------------------------------------------------------
+		// Ratio of core time spent running jobs, in [0, 1].
+		// -----------------------------------------------------------------------------------------------
+		float get_utilization() const
+		{
+			return m_makespanInUs > 0u ? (float)m_busyTimeInUs / (float)(m_makespanInUs * m_numCores) : 0.0f;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Speedup over running the trace serially, without overheads.
+		// -----------------------------------------------------------------------------------------------
+		float get_speedup() const
+		{
+			return m_makespanInUs > 0u ? (float)m_workInUs / (float)m_makespanInUs : 0.0f;
+		}
+	};
+
+	// -----------------------------------------------------------------------------------------------
+	// A discrete event simulator replaying a recorded job trace (durations and dependencies) under a scheduling policy, at any number
+	// of virtual cores. It predicts the makespan and utilization of a workload, to size hardware and compare policies offline.
+	// Jobs are assumed to take the same time regardless of where and when they run, so cache and contention effects aren't modelled
+	// beyond the fixed overheads of sim_desc.
+	// -----------------------------------------------------------------------------------------------
+	class trace_simulator
+	{
+	public:
+		// -----------------------------------------------------------------------------------------------
+		// Add a job to the trace, returning its index.
+		// -----------------------------------------------------------------------------------------------
+		uint32_t add_job(const std::string& _label, uint64_t _durationInUs, uint32_t _priority = 0u)
+		{
+			trace_job j;
+			j.m_label = _label;
+			j.m_durationInUs = _durationInUs;
+			j.m_priority = _priority;
+			m_jobs.push_back(j);
+
+			return (uint32_t)m_jobs.size() - 1u;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Make a job wait for another one to finish.
+		// -----------------------------------------------------------------------------------------------
+		void add_dependency(uint32_t _job, uint32_t _dependency)
+		{
+			YATM_ASSERT(_job < m_jobs.size() && _dependency < m_jobs.size());
+			m_jobs[_job].m_dependencies.push_back(_dependency);
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Append jobs from a text trace, one job per line: "label duration_in_us priority [dependency ...]", where dependencies are
+		// indices of jobs in the trace (forward references are allowed). Empty lines and lines starting with '#' are skipped.
+		// Returns false if a line is malformed.
+		// -----------------------------------------------------------------------------------------------
+		bool parse(const char* _text)
+		{
+			YATM_ASSERT(_text != nullptr);
+
+			const size_t first_job = m_jobs.size();
+			const char* line = _text;
+			while (*line != '\0')
+			{
+				const char* const line_end = line + strcspn(line, "\n");
+				const std::string text(line, line_end);
+				line = *line_end != '\0' ? line_end + 1 : line_end;
+
+				const char* p = text.c_str();
+				p += strspn(p, " \t\r");
+				if (*p == '\0' || *p == '#')
+				{
+					continue;
+				}
+
+				const size_t label_length = strcspn(p, " \t\r");
+				const std::string label(p, label_length);
+				p += label_length;
+
+				char* end = nullptr;
+				const uint64_t duration = strtoull(p, &end, 10);
+				if (end == p)
+				{
+					return false;
+				}
+				p = end;
+
+				const uint64_t priority = strtoull(p, &end, 10);
+				if (end == p)
+				{
+					return false;
+				}
+				p = end;
+
+				const uint32_t j = add_job(label, duration, (uint32_t)priority);
+				for (;;)
+				{
+					const uint64_t dependency = strtoull(p, &end, 10);
+					if (end == p)
+					{
+						break;
+					}
+					m_jobs[j].m_dependencies.push_back((uint32_t)(first_job + dependency));
+					p = end;
+				}
+
+				if (*(p + strspn(p, " \t\r")) != '\0')
+				{
+					return false;
+				}
+			}
+
+			for (const trace_job& j : m_jobs)
+			{
+				for (uint32_t d : j.m_dependencies)
+				{
+					if (d >= m_jobs.size())
+					{
+						return false;
+					}
+				}
+			}
+
+			return true;
+		}
+
+		// -----------------------------------------------------------------------------------------------
+		// Remove all jobs.
+		// -----------------------------------------------------------------------------------------------
+		void clear() { m_jobs.clear(); }
+
+		// -----------------------------------------------------------------------------------------------
+		// Return the number of jobs in the trace.
+		// -----------------------------------------------------------------------------------------------
+		size_t get_num_jobs() const { return m_jobs.size(); }
+
+		// -----------------------------------------------------------------------------------------------
+		// Simulate the trace. Returns false if the dependencies have a cycle.
+		// -----------------------------------------------------------------------------------------------
+		bool run(const sim_desc& _desc, sim_result& _result) const
+		{
+			YATM_ASSERT(_desc.m_numCores > 0u);
+
+			const uint32_t num_jobs = (uint32_t)m_jobs.size();
+			const uint32_t num_cores = _desc.m_numCores;
+
+			_result = sim_result();
+			_result.m_numCores = num_cores;
+
+			// Jobs waiting on each job, and how many dependencies each job has left.
+			std::vector<std::vector<uint32_t>> dependents(num_jobs);
+			std::vector<uint32_t> pending(num_jobs);
+			for (uint32_t i = 0; i < num_jobs; ++i)
+			{
+				pending[i] = (uint32_t)m_jobs[i].m_dependencies.size();
+				for (uint32_t d : m_jobs[i].m_dependencies)
+				{
+					dependents[d].push_back(i);
+				}
+				_result.m_workInUs += m_jobs[i].m_durationInUs;
+			}
+
+			// Work left on the longest path starting at each job, computed in reverse topological order.
+			std::vector<uint64_t> path_length(num_jobs, 0u);
+			if (!compute_path_lengths(dependents, pending, path_length))
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < num_jobs; ++i)
+			{
+				_result.m_criticalPathInUs = std::max(_result.m_criticalPathInUs, path_length[i]);
+			}
+
+			// Ready jobs: a single heap ordered by the policy, or a queue per core when work stealing.
+			auto before = [this, &_desc, &path_length](uint32_t _a, uint32_t _b)
+			{
+				switch (_desc.m_policy)
+				{
+				case sim_policy::priority:
+					if (m_jobs[_a].m_priority != m_jobs[_b].m_priority)
+					{
+						return m_jobs[_a].m_priority > m_jobs[_b].m_priority;
+					}
+					break;
+				case sim_policy::critical_path:
+					if (path_length[_a] != path_length[_b])
+					{
+						return path_length[_a] > path_length[_b];
+					}
+					break;
+				default:
+					break;
+				}
+				return _a < _b;
+			};
+			auto heap_order = [&before](uint32_t _a, uint32_t _b) { return before(_b, _a); };
+
+			const bool stealing = _desc.m_policy == sim_policy::work_stealing;
+			std::vector<uint32_t> ready;
+			std::vector<core_queue> queues(stealing ? num_cores : 0u);
+
+			auto make_ready = [&](uint32_t _job, uint32_t _core)
+			{
+				if (stealing)
+				{
+					queues[_core].m_jobs.push_back(_job);
+				}
+				else
+				{
+					ready.push_back(_job);
+					std::push_heap(ready.begin(), ready.end(), heap_order);
+				}
+			};
+
+			for (uint32_t i = 0, next_core = 0; i < num_jobs; ++i)
+			{
+				if (m_jobs[i].m_dependencies.empty())
+				{
+					make_ready(i, next_core++ % num_cores);
+				}
+			}
+
+			// Completion events, earliest first.
+			std::vector<sim_event> events;
+			auto event_order = [](const sim_event& _a, const sim_event& _b) { return _a.m_time > _b.m_time || (_a.m_time == _b.m_time && _a.m_core > _b.m_core); };
+
+			std::vector<bool> is_busy(num_cores, false);
+			uint64_t now = 0u;
+			uint32_t num_finished = 0u;
+
+			for (;;)
+			{
+				// Hand ready jobs to idle cores.
+				for (uint32_t c = 0; c < num_cores; ++c)
+				{
+					if (is_busy[c])
+					{
+						continue;
+					}
+
+					uint32_t j = ~0u;
+					uint64_t overhead = _desc.m_dispatchOverheadInUs;
+					if (stealing)
+					{
+						j = queues[c].pop_back();
+						if (j == ~0u)
+						{
+							// Steal the oldest job of the longest queue.
+							uint32_t victim = ~0u;
+							for (uint32_t v = 0; v < num_cores; ++v)
+							{
+								if (queues[v].size() > 0u && (victim == ~0u || queues[v].size() > queues[victim].size()))
+								{
+									victim = v;
+								}
+							}
+
+							if (victim != ~0u)
+							{
+								j = queues[victim].pop_front();
+								overhead += _desc.m_stealOverheadInUs;
+								_result.m_steals++;
+							}
+						}
+					}
+					else if (!ready.empty())
+					{
+						std::pop_heap(ready.begin(), ready.end(), heap_order);
+						j = ready.back();
+						ready.pop_back();
+					}
+
+					if (j == ~0u)
+					{
+						continue;
+					}
+
+					const uint64_t busy_time = overhead + m_jobs[j].m_durationInUs;
+					_result.m_busyTimeInUs += busy_time;
+					is_busy[c] = true;
+
+					events.push_back({ now + busy_time, c, j });
+					std::push_heap(events.begin(), events.end(), event_order);
+				}
+
+				if (events.empty())
+				{
+					break;
+				}
+
+				// Advance to the next completion, releasing the jobs waiting on it.
+				std::pop_heap(events.begin(), events.end(), event_order);
+				const sim_event e = events.back();
+				events.pop_back();
+
+				now = e.m_time;
+				is_busy[e.m_core] = false;
+				num_finished++;
+
+				for (uint32_t d : dependents[e.m_job])
+				{
+					if (--pending[d] == 0u)
+					{
+						make_ready(d, e.m_core);
+					}
+				}
+			}
+
+			YATM_ASSERT(num_finished == num_jobs);
+			_result.m_makespanInUs = now;
+			return true;
+		}
+
+	private:
+		struct trace_job
+		{
+			std::string				m_label;
+			uint64_t				m_durationInUs = 0u;
+			uint32_t				m_priority = 0u;		// Higher runs first under sim_policy::priority.
+			std::vector<uint32_t>	m_dependencies;			// Jobs that must finish before this one starts.
+		};
+
+		struct sim_event
+		{
+			uint64_t	m_time;
+			uint32_t	m_core;
+			uint32_t	m_job;
+		};
+
+		// A per-core queue for work stealing: the owner takes from the back, thieves from the front.
+		struct core_queue
+		{
+			std::vector<uint32_t>	m_jobs;
+			size_t					m_head = 0u;
+
+			size_t size() const { return m_jobs.size() - m_head; }
+			uint32_t pop_back()
+			{
+				if (size() == 0u)
+				{
+					return ~0u;
+				}
+				const uint32_t j = m_jobs.back();
+				m_jobs.pop_back();
+				return j;
+			}
+			uint32_t pop_front() { return size() > 0u ? m_jobs[m_head++] : ~0u; }
+		};
+
+		std::vector<trace_job>	m_jobs;
+
+		// -----------------------------------------------------------------------------------------------
+		// Compute the length of the longest path of work starting at each job. Returns false if the dependencies have a cycle.
+		// -----------------------------------------------------------------------------------------------
+		bool compute_path_lengths(const std::vector<std::vector<uint32_t>>& _dependents, std::vector<uint32_t> _pending, std::vector<uint64_t>& _pathLength) const
+		{
+			std::vector<uint32_t> order;
+			order.reserve(m_jobs.size());
+			for (uint32_t i = 0; i < m_jobs.size(); ++i)
+			{
+				if (_pending[i] == 0u)
+				{
+					order.push_back(i);
+				}
+			}
+
+			for (size_t i = 0; i < order.size(); ++i)
+			{
+				for (uint32_t d : _dependents[order[i]])
+				{
+					if (--_pending[d] == 0u)
+					{
+						order.push_back(d);
+					}
+				}
+			}
+
+			if (order.size() != m_jobs.size())
+			{
+				return false;
+			}
+
+			for (size_t i = order.size(); i-- > 0; )
+			{
+				uint64_t longest_after = 0u;
+				for (uint32_t d : _dependents[order[i]])
+				{
+					longest_after = std::max(longest_after, _pathLength[d]);
+				}
+				_pathLength[order[i]] = m_jobs[order[i]].m_durationInUs + longest_after;
+			}
+
+			return true;
+		}
+	};
+}
\ No newline at end of file